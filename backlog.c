@@ -0,0 +1,150 @@
+// backlog.c
+#include "backlog.h"
+#include "hash_utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#define MAX_QUEUED_FILE     "/proc/sys/fs/inotify/max_queued_events"
+#define DEFAULT_MAX_QUEUED  16384
+#define HIGH_ON             0.50    // Fill fraction that enters each level...
+#define HIGH_OFF            0.25    // ...and the one that leaves it
+#define CRITICAL_ON         0.80
+#define CRITICAL_OFF        0.60
+#define COALESCE_SLOTS      2048    // Power of two, > events per read buffer
+#define COALESCE_MASK       (IN_MODIFY | IN_ATTRIB)
+
+// One file seen in the current buffer
+typedef struct {
+    uint64_t key;               // Hash of wd and name
+    uint32_t generation;        // Buffer it belongs to; older = empty
+    uint32_t mask;              // Repeatable events seen since the last other event
+} coalesce_slot;
+
+static int queue_fd = -1;
+static backlog_stats stats;
+static uint64_t bytes_read = 0;
+static uint64_t events_read = 0;
+static coalesce_slot slots[COALESCE_SLOTS];
+static uint32_t generation = 0;
+
+int backlog_init(int fd) {
+    memset(&stats, 0, sizeof(stats));
+    queue_fd = fd;
+    stats.max_queued = DEFAULT_MAX_QUEUED;
+
+    FILE *fp = fopen(MAX_QUEUED_FILE, "r");
+    if (fp) {
+        unsigned int value;
+        if (fscanf(fp, "%u", &value) == 1 && value > 0) {
+            stats.max_queued = value;
+        }
+        fclose(fp);
+    }
+    return 0;
+}
+
+backlog_level backlog_sample() {
+    int pending = 0;
+    if (queue_fd < 0 || ioctl(queue_fd, FIONREAD, &pending) < 0) {
+        return stats.level;
+    }
+
+    // Names are padded, so estimate from what this workload actually looks like
+    double record = events_read ? (double)bytes_read / (double)events_read
+                                : (double)(sizeof(struct inotify_event) + 16);
+    stats.bytes = (uint32_t)pending;
+    stats.events = (uint32_t)(pending / record + 0.5);
+    stats.fill = (double)stats.events / stats.max_queued;
+    if (stats.bytes > stats.peak_bytes) {
+        stats.peak_bytes = stats.bytes;
+    }
+    if (stats.fill > stats.peak_fill) {
+        stats.peak_fill = stats.fill;
+    }
+
+    switch (stats.level) {
+        case BACKLOG_NORMAL:
+            if (stats.fill >= CRITICAL_ON) {
+                stats.level = BACKLOG_CRITICAL;
+            } else if (stats.fill >= HIGH_ON) {
+                stats.level = BACKLOG_HIGH;
+            }
+            break;
+        case BACKLOG_HIGH:
+            if (stats.fill >= CRITICAL_ON) {
+                stats.level = BACKLOG_CRITICAL;
+            } else if (stats.fill < HIGH_OFF) {
+                stats.level = BACKLOG_NORMAL;
+            }
+            break;
+        case BACKLOG_CRITICAL:
+            if (stats.fill < HIGH_OFF) {
+                stats.level = BACKLOG_NORMAL;
+            } else if (stats.fill < CRITICAL_OFF) {
+                stats.level = BACKLOG_HIGH;
+            }
+            break;
+    }
+    return stats.level;
+}
+
+void backlog_note_read(size_t bytes, uint32_t events) {
+    bytes_read += bytes;
+    events_read += events;
+}
+
+void backlog_note_overflow() {
+    stats.overflows++;
+}
+
+void backlog_batch_begin() {
+    generation++;
+    if (generation == 0) {
+        memset(slots, 0, sizeof(slots));  // Wrapped: stale slots could look current
+        generation = 1;
+    }
+}
+
+int backlog_coalesce(const struct inotify_event *event) {
+    if (!event->len) {
+        return 0;
+    }
+
+    uint64_t key = xxh64(event->name, strlen(event->name), (uint64_t)(uint32_t)event->wd);
+    uint32_t slot = (uint32_t)key & (COALESCE_SLOTS - 1);
+    for (uint32_t probes = 0; probes < COALESCE_SLOTS; probes++) {
+        coalesce_slot *s = &slots[slot];
+        if (s->generation != generation) {
+            // First time this buffer: remember it
+            s->key = key;
+            s->generation = generation;
+            s->mask = event->mask & COALESCE_MASK;
+            return 0;
+        }
+        if (s->key == key) {
+            uint32_t type = event->mask & COALESCE_MASK;
+            if (type && (event->mask & ~(COALESCE_MASK | IN_ISDIR)) == 0 && (s->mask & type) == type) {
+                stats.coalesced++;
+                return 1;
+            }
+            // Anything else (create, delete, move) orders against later repeats
+            s->mask = (event->mask & ~(COALESCE_MASK | IN_ISDIR)) ? 0 : s->mask | type;
+            return 0;
+        }
+        slot = (slot + 1) & (COALESCE_SLOTS - 1);
+    }
+    return 0;
+}
+
+void backlog_get_stats(backlog_stats *out) {
+    *out = stats;
+}
+
+const char *backlog_level_name(backlog_level level) {
+    switch (level) {
+        case BACKLOG_HIGH:     return "high";
+        case BACKLOG_CRITICAL: return "critical";
+        default:               return "normal";
+    }
+}
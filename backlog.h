@@ -0,0 +1,53 @@
+// backlog.h
+#ifndef BACKLOG_H
+#define BACKLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+
+// Pressure on the kernel queue, with hysteresis between levels
+typedef enum {
+    BACKLOG_NORMAL = 0,
+    BACKLOG_HIGH,               // Half full: coalesce repeated events
+    BACKLOG_CRITICAL            // Close to overflowing: favor reading over handling
+} backlog_level;
+
+typedef struct {
+    uint32_t bytes;             // Waiting in the kernel queue at the last sample
+    uint32_t peak_bytes;
+    uint32_t events;            // Estimated events waiting
+    uint32_t max_queued;        // fs.inotify.max_queued_events
+    double fill;                // events / max_queued
+    double peak_fill;
+    backlog_level level;
+    uint64_t coalesced;         // Events dropped as repeats under pressure
+    uint64_t overflows;         // IN_Q_OVERFLOW events received
+} backlog_stats;
+
+// Read the queue limit; fd is the inotify descriptor to sample
+int backlog_init(int fd);
+
+// Sample the pending byte count (FIONREAD); call once per loop cycle.
+// Returns the current level.
+backlog_level backlog_sample();
+
+// Account a buffer read from the queue (keeps the average record size)
+void backlog_note_read(size_t bytes, uint32_t events);
+
+// Count a kernel queue overflow
+void backlog_note_overflow();
+
+// Start coalescing a new read buffer
+void backlog_batch_begin();
+
+// Is this a repeated IN_MODIFY/IN_ATTRIB for a file already seen in the
+// current buffer (with nothing else in between)? Callers skip it.
+int backlog_coalesce(const struct inotify_event *event);
+
+void backlog_get_stats(backlog_stats *stats);
+
+// Level name for messages
+const char *backlog_level_name(backlog_level level);
+
+#endif // BACKLOG_H
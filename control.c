@@ -0,0 +1,287 @@
+// control.c
+#include "control.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define CONTROL_BACKLOG     16
+#define CONTROL_LINE_MAX    (PATH_MAX + 64)
+
+static int listen_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+// A connected client; replies queue in out until the socket takes them
+typedef struct {
+    int fd;                     // -1 = free slot
+    char in[CONTROL_LINE_MAX];
+    size_t used;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    int closing;                // Peer closed its end; drop once out is sent
+} control_client;
+
+static control_client clients[CONTROL_CLIENTS];
+static int clients_ready = 0;
+
+int control_open(const char *path) {
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    // Replace a socket left behind by a previous run; the umask keeps
+    // other users from connecting before the chmod below
+    unlink(path);
+    mode_t old_mask = umask(077);
+    int rc = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc < 0 || chmod(path, 0600) < 0 || listen(sock, CONTROL_BACKLOG) < 0) {
+        int saved = errno;
+        close(sock);
+        errno = saved;
+        return -1;
+    }
+
+    strcpy(socket_path, path);
+    listen_fd = sock;
+    if (!clients_ready) {
+        for (int i = 0; i < CONTROL_CLIENTS; i++) {
+            clients[i].fd = -1;
+        }
+        clients_ready = 1;
+    }
+    return sock;
+}
+
+static void drop_client(control_client *c) {
+    close(c->fd);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+static void queue_reply(control_client *c, const char *data, size_t len) {
+    char *grown = realloc(c->out, c->out_len + len);
+    if (!grown) {
+        return;
+    }
+    memcpy(grown + c->out_len, data, len);
+    c->out = grown;
+    c->out_len += len;
+}
+
+// Send as much queued output as the socket takes; returns -1 on error
+static int send_pending(control_client *c) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->out_sent += (size_t)n;
+    }
+    free(c->out);
+    c->out = NULL;
+    c->out_len = c->out_sent = 0;
+    return 0;
+}
+
+// Split "COMMAND args" in place, run it and queue the reply
+static void run_line(control_client *c, char *line, control_handler handler) {
+    while (isspace((unsigned char)*line)) {
+        line++;
+    }
+    if (*line == '\0') {
+        return;
+    }
+
+    char *args = line;
+    while (*args && !isspace((unsigned char)*args)) {
+        args++;
+    }
+    if (*args) {
+        *args++ = '\0';
+    }
+    while (isspace((unsigned char)*args)) {
+        args++;
+    }
+    size_t len = strlen(args);
+    while (len > 0 && isspace((unsigned char)args[len - 1])) {
+        args[--len] = '\0';
+    }
+
+    char *reply = NULL;
+    size_t reply_len = 0;
+    FILE *out = open_memstream(&reply, &reply_len);
+    if (!out) {
+        return;
+    }
+
+    const char *error = handler(line, args, out);
+    if (error) {
+        fprintf(out, "ERR %s\n", error);
+    } else {
+        fprintf(out, "OK\n");
+    }
+    fclose(out);
+
+    queue_reply(c, reply, reply_len);
+    free(reply);
+}
+
+// Run the complete lines buffered for a client
+static void run_lines(control_client *c, control_handler handler) {
+    char *start = c->in;
+    char *nl;
+    while ((nl = memchr(start, '\n', c->used - (size_t)(start - c->in))) != NULL) {
+        *nl = '\0';
+        run_line(c, start, handler);
+        start = nl + 1;
+    }
+    c->used -= (size_t)(start - c->in);
+    memmove(c->in, start, c->used);
+}
+
+// Take whatever the client has sent without waiting for more
+static void read_client(control_client *c, control_handler handler) {
+    while (!c->closing) {
+        ssize_t n = recv(c->fd, c->in + c->used, sizeof(c->in) - 1 - c->used, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->closing = 1;
+                c->used = 0;
+            }
+            return;
+        }
+        if (n == 0) {
+            // A last command without a trailing newline
+            if (c->used > 0) {
+                c->in[c->used] = '\0';
+                run_line(c, c->in, handler);
+                c->used = 0;
+            }
+            c->closing = 1;
+            return;
+        }
+
+        c->used += (size_t)n;
+        run_lines(c, handler);
+        if (c->used == sizeof(c->in) - 1) {
+            queue_reply(c, "ERR line too long\n", 18);
+            c->closing = 1;
+            c->used = 0;
+        }
+    }
+}
+
+static void accept_clients() {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // EAGAIN: nobody else waiting
+        }
+
+        int slot = 0;
+        while (slot < CONTROL_CLIENTS && clients[slot].fd >= 0) {
+            slot++;
+        }
+        if (slot == CONTROL_CLIENTS) {
+            send(fd, "ERR too many clients\n", 21, MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+        clients[slot].fd = fd;
+    }
+}
+
+int control_pollfds(struct pollfd *pfds) {
+    int n = 0;
+    if (listen_fd < 0) {
+        return 0;
+    }
+
+    pfds[n].fd = listen_fd;
+    pfds[n].events = POLLIN;
+    pfds[n++].revents = 0;
+    for (int i = 0; i < CONTROL_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            pfds[n].fd = clients[i].fd;
+            pfds[n].events = clients[i].out_len ? POLLOUT : POLLIN;
+            pfds[n++].revents = 0;
+        }
+    }
+    return n;
+}
+
+void control_serve(control_handler handler) {
+    if (listen_fd < 0) {
+        return;
+    }
+
+    accept_clients();
+    for (int i = 0; i < CONTROL_CLIENTS; i++) {
+        control_client *c = &clients[i];
+        if (c->fd < 0) {
+            continue;
+        }
+
+        // Don't read more commands while earlier replies are still queued
+        if (!c->out_len) {
+            read_client(c, handler);
+        }
+        if (send_pending(c) < 0 || (c->closing && !c->out_len)) {
+            drop_client(c);
+        }
+    }
+}
+
+void control_forget() {
+    if (listen_fd >= 0) {
+        for (int i = 0; i < CONTROL_CLIENTS; i++) {
+            if (clients[i].fd >= 0) {
+                drop_client(&clients[i]);
+            }
+        }
+        close(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+void control_close() {
+    if (listen_fd >= 0) {
+        for (int i = 0; i < CONTROL_CLIENTS; i++) {
+            if (clients[i].fd >= 0) {
+                drop_client(&clients[i]);
+            }
+        }
+        close(listen_fd);
+        unlink(socket_path);
+        listen_fd = -1;
+    }
+}
@@ -0,0 +1,36 @@
+// control.h
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdio.h>
+#include <poll.h>
+
+#define CONTROL_CLIENTS     16      // Connections served at once
+#define CONTROL_POLLFDS     (CONTROL_CLIENTS + 1)
+
+// Run one command. args is the rest of the line with surrounding blanks
+// removed (possibly empty). Extra reply lines may be written to out.
+// Returns NULL on success or an error message.
+typedef const char *(*control_handler)(const char *command, char *args, FILE *out);
+
+// Listen for commands on a Unix socket at path (owner-only access).
+// Returns the listening descriptor to poll, or -1 on error.
+int control_open(const char *path);
+
+// Fill pfds (room for CONTROL_POLLFDS) with the listening socket and the
+// connected clients. Returns the number of entries used.
+int control_pollfds(struct pollfd *pfds);
+
+// Accept waiting clients, then read what each client has sent and answer
+// every complete line: each reply is the handler's output followed by
+// "OK" or "ERR <message>". Never blocks; partial lines wait for more input.
+void control_serve(control_handler handler);
+
+// Close the socket and remove it from the filesystem
+void control_close();
+
+// Close the listening socket and client connections but leave the socket
+// file in place (for a forked child of the process that serves it)
+void control_forget();
+
+#endif // CONTROL_H
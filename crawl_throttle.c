@@ -0,0 +1,124 @@
+// crawl_throttle.c
+#include "crawl_throttle.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From linux/ioprio.h, which is not always installed
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_WHO_PROCESS  1
+
+#define LATENCY_SAMPLES     16          // Directories before the baseline is trusted
+#define BACKOFF_RATIO       4           // Back off when latency exceeds baseline * this
+#define RECOVER_RATIO       2           // Recover when latency is under baseline * this
+#define ADJUST_NS           100000000ULL // At most one rate change per 100ms
+#define MIN_RATE_DIVISOR    64          // Never slow below 1/64 of the configured rate
+#define LATENCY_FLOOR_NS    1000000ULL  // Under 1ms per directory the disk is not struggling
+
+static double max_rate = 0;             // Configured directories per second (0 = unlimited)
+static double rate = 0;                 // Current rate after backoff
+static int use_idle_io = 0;
+static int active = 0;
+static int saved_ioprio = -1;
+
+static uint64_t next_slot = 0;          // Earliest time the next directory may start
+static uint64_t last_return = 0;        // When the crawler was last released
+static uint64_t last_adjust = 0;
+static uint64_t latency = 0;            // Moving average of per-directory work (ns)
+static uint64_t baseline = 0;           // Lowest settled moving average seen
+static uint64_t samples = 0;
+
+static uint64_t dirs_seen = 0;
+static uint64_t slept_ns = 0;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void crawl_throttle_init(double dirs_per_sec, int idle_io) {
+    max_rate = rate = dirs_per_sec > 0 ? dirs_per_sec : 0;
+    use_idle_io = idle_io;
+}
+
+void crawl_begin() {
+    if (use_idle_io && !active) {
+        saved_ioprio = (int)syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    }
+    active = 1;
+    next_slot = last_return = now_ns();
+}
+
+void crawl_end() {
+    if (use_idle_io && active && saved_ioprio >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, saved_ioprio);
+    }
+    active = 0;
+}
+
+// AIMD on the rate: halve it while the disk is slow, creep back when it is not
+static void adapt(uint64_t now) {
+    if (samples < LATENCY_SAMPLES || now - last_adjust < ADJUST_NS) {
+        return;
+    }
+
+    if (latency > baseline * BACKOFF_RATIO && latency > LATENCY_FLOOR_NS) {
+        rate /= 2;
+        if (rate < max_rate / MIN_RATE_DIVISOR) {
+            rate = max_rate / MIN_RATE_DIVISOR;
+        }
+        last_adjust = now;
+    } else if (latency < baseline * RECOVER_RATIO && rate < max_rate) {
+        rate += max_rate / 16;
+        if (rate > max_rate) {
+            rate = max_rate;
+        }
+        last_adjust = now;
+    }
+}
+
+void crawl_throttle() {
+    if (!active) {
+        return;
+    }
+    dirs_seen++;
+    if (max_rate <= 0) {
+        return;
+    }
+
+    // Time the crawler spent since we last let it go is the cost of this directory
+    uint64_t now = now_ns();
+    uint64_t work = now - last_return;
+    latency = samples ? latency - latency / 8 + work / 8 : work;
+    samples++;
+    if (samples >= LATENCY_SAMPLES && (baseline == 0 || latency < baseline)) {
+        baseline = latency ? latency : 1;
+    }
+    adapt(now);
+
+    uint64_t interval = (uint64_t)(1e9 / rate);
+    if (next_slot + interval < now) {
+        next_slot = now;  // Idle gaps don't bank credit for a burst
+    }
+    next_slot += interval;
+
+    if (next_slot > now) {
+        uint64_t wait = next_slot - now;
+        struct timespec ts = { (time_t)(wait / 1000000000ULL), (long)(wait % 1000000000ULL) };
+        while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+            // Sleep out the remainder
+        }
+        slept_ns += wait;
+    }
+    last_return = now_ns();
+}
+
+void crawl_stats(uint64_t *dirs, uint64_t *slept_ms, double *current_rate) {
+    *dirs = dirs_seen;
+    *slept_ms = slept_ns / 1000000;
+    *current_rate = rate;
+}
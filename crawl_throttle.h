@@ -0,0 +1,24 @@
+// crawl_throttle.h
+#ifndef CRAWL_THROTTLE_H
+#define CRAWL_THROTTLE_H
+
+#include <stdint.h>
+
+// Limit crawls to dirs_per_sec directories per second (0 = unlimited) and
+// optionally run them in the idle I/O scheduling class
+void crawl_throttle_init(double dirs_per_sec, int idle_io);
+
+// Enter/leave a crawl phase. Idle I/O priority set here is inherited by
+// threads started inside the phase (e.g. hashing workers).
+void crawl_begin();
+void crawl_end();
+
+// Called by crawlers once per directory; sleeps to hold the rate and
+// lowers it while directories take markedly longer to read than usual.
+// A no-op outside a crawl phase. Not thread-safe: crawl from one thread.
+void crawl_throttle();
+
+// Directories visited, total time slept and the current adapted rate
+void crawl_stats(uint64_t *dirs, uint64_t *slept_ms, double *rate);
+
+#endif // CRAWL_THROTTLE_H
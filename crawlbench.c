@@ -0,0 +1,505 @@
+/**
+ * crawlbench - measure fswatcher's recursive startup over synthetic trees
+ *
+ * Each tree shape is generated under a scratch directory (tmpfs by
+ * default, so the disk stays out of the numbers) and fswatcher is started
+ * on it in recursive mode with a one-event benchmark, which crawls, adds
+ * every watch and exits. Wall time and peak RSS come from timed runs, the
+ * syscall count from one extra run under ptrace. An empty tree is measured
+ * the same way and subtracted, leaving the cost of the crawl itself.
+ * Results are printed as JSON for tracking across versions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+
+#define DEFAULT_SCRATCH "/dev/shm"
+#define TMPFS_MAGIC_NUMBER 0x01021994
+#define MAX_RUNS 32
+
+// A full tree: fanout^level directories at each level up to depth, each
+// holding files_per_dir empty files
+typedef struct {
+    const char *name;
+    uint32_t fanout;
+    uint32_t depth;
+    uint32_t files_per_dir;
+} tree_shape;
+
+// "make bench-crawl" builds fswatcher with a watch table that fits every
+// shape; a crawl that still hits MAX_WATCHES is reported as incomplete
+// rather than measured
+static const tree_shape shapes[] = {
+    { "wide",     500,   1,    20 },   // One directory with many subdirectories
+    { "deep",       1, 400,     5 },   // A single chain of nested directories
+    { "files",      4,   1, 25000 },   // Few directories, many files
+    { "dirs",      30,   3,     2 },   // Many directories (27931), almost no files
+    { "balanced",   6,   3,    50 }
+};
+#define SHAPE_COUNT (sizeof(shapes) / sizeof(shapes[0]))
+
+// What one fswatcher startup cost
+typedef struct {
+    double wall_ms;
+    long max_rss_kb;
+    long watches;               // From "Total watches: N" (-1 if missing)
+} run_result;
+
+// Medians and counts for one tree
+typedef struct {
+    uint64_t dirs;
+    uint64_t files;
+    double generate_ms;
+    double wall_ms;             // Median over the timed runs
+    double wall_min_ms;
+    long max_rss_kb;
+    long watches;
+    long syscalls;              // -1 if ptrace is unavailable
+} tree_result;
+
+static char **watcher_argv = NULL;      // fswatcher and its extra options
+static int watcher_argc = 0;
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * Create the directories and files of one level below path
+ */
+static int generate(char *path, size_t len, const tree_shape *shape, uint32_t level,
+                    uint32_t files_per_dir, tree_result *r) {
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    r->dirs++;
+
+    for (uint32_t f = 0; f < files_per_dir; f++) {
+        int n = snprintf(path + len, PATH_MAX - len, "/f%u", f);
+        if (n < 0 || (size_t)n >= PATH_MAX - len) {
+            return -1;
+        }
+        int fd = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+        close(fd);
+        r->files++;
+    }
+
+    if (level < shape->depth) {
+        for (uint32_t d = 0; d < shape->fanout; d++) {
+            int n = snprintf(path + len, PATH_MAX - len, "/d%u", d);
+            if (n < 0 || (size_t)n >= PATH_MAX - len ||
+                generate(path, len + (size_t)n, shape, level + 1, files_per_dir, r) < 0) {
+                return -1;
+            }
+        }
+    }
+    path[len] = '\0';
+    return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    (void)sb;
+    (void)typeflag;
+    (void)ftwbuf;
+    return remove(path) < 0 ? -1 : 0;
+}
+
+static void remove_tree(const char *root) {
+    nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+/**
+ * Start fswatcher on root in a child. With trace set, the child stops at
+ * exec so the parent can follow its system calls.
+ */
+static pid_t spawn_watcher(const char *root, int out_fd, int trace) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    char **argv = calloc((size_t)watcher_argc + 5, sizeof(*argv));
+    if (!argv) {
+        _exit(127);
+    }
+    int n = 0;
+    argv[n++] = watcher_argv[0];
+    argv[n++] = "-r";
+    argv[n++] = "--benchmark=1";
+    for (int i = 1; i < watcher_argc; i++) {
+        argv[n++] = watcher_argv[i];
+    }
+    argv[n++] = (char *)root;
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(out_fd, STDOUT_FILENO);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDERR_FILENO);
+    }
+    if (trace && ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0) {
+        _exit(126);
+    }
+    execv(argv[0], argv);
+    _exit(127);
+}
+
+/**
+ * Read the watch count fswatcher printed at startup
+ */
+static long parse_watches(int fd) {
+    char line[512];
+    long watches = -1;
+
+    FILE *fp = fdopen(dup(fd), "r");
+    if (!fp) {
+        return -1;
+    }
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "Total watches: %ld", &watches) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return watches;
+}
+
+/**
+ * One untraced startup: wall time, peak RSS and watch count
+ */
+static int timed_run(const char *root, run_result *r) {
+    FILE *out = tmpfile();
+    if (!out) {
+        return -1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = spawn_watcher(root, fileno(out), 0);
+    if (pid < 0) {
+        fclose(out);
+        return -1;
+    }
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        fclose(out);
+        return -1;
+    }
+    r->wall_ms = elapsed_ms(&start);
+    r->max_rss_kb = ru.ru_maxrss;
+    r->watches = parse_watches(fileno(out));
+    fclose(out);
+    return WIFEXITED(status) && WEXITSTATUS(status) < 126 ? 0 : -1;
+}
+
+/**
+ * One startup under ptrace, counting system call entries
+ */
+static long count_syscalls(const char *root) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) {
+        return -1;
+    }
+    pid_t pid = spawn_watcher(root, null_fd, 1);
+    close(null_fd);
+    if (pid < 0) {
+        return -1;
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) {
+        return -1;  // Tracing refused
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+
+    long stops = 0;
+    int deliver = 0;
+    while (1) {
+        if (ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)deliver) < 0 ||
+            waitpid(pid, &status, 0) < 0) {
+            break;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            break;
+        }
+        deliver = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            stops++;
+        } else {
+            deliver = WSTOPSIG(status);  // A real signal: pass it on
+        }
+    }
+
+    // Entry and exit stops, except exit_group which never returns
+    return (stops + 1) / 2;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Time, trace and measure fswatcher on one prepared tree
+ */
+static int measure(const char *root, int runs, tree_result *r) {
+    double wall[MAX_RUNS];
+
+    r->max_rss_kb = 0;
+    r->watches = -1;
+    for (int i = 0; i < runs; i++) {
+        run_result run;
+        if (timed_run(root, &run) < 0) {
+            return -1;
+        }
+        wall[i] = run.wall_ms;
+        if (run.max_rss_kb > r->max_rss_kb) {
+            r->max_rss_kb = run.max_rss_kb;
+        }
+        r->watches = run.watches;
+    }
+
+    qsort(wall, (size_t)runs, sizeof(wall[0]), by_value);
+    r->wall_min_ms = wall[0];
+    r->wall_ms = wall[runs / 2];
+    r->syscalls = count_syscalls(root);
+    return 0;
+}
+
+// Did the crawl watch every directory below the root? (The empty
+// baseline already accounts for the root's own watches.)
+static int crawl_complete(const tree_result *r, const tree_result *base) {
+    return r->watches - base->watches == (long)r->dirs - 1;
+}
+
+static void print_json_result(const char *name, const tree_result *r, const tree_result *base, int last) {
+    long watches = r->watches - base->watches;
+    printf("    {\"shape\": \"%s\", \"dirs\": %llu, \"files\": %llu, \"generate_ms\": %.1f,\n",
+           name, (unsigned long long)r->dirs, (unsigned long long)r->files, r->generate_ms);
+    printf("     \"complete\": %s,\n", crawl_complete(r, base) ? "true" : "false");
+    printf("     \"watches\": %ld, \"startup_ms\": %.3f, \"startup_min_ms\": %.3f, \"crawl_ms\": %.3f,\n",
+           r->watches, r->wall_ms, r->wall_min_ms, r->wall_ms - base->wall_ms);
+    if (r->syscalls >= 0 && base->syscalls >= 0) {
+        printf("     \"syscalls\": %ld, \"crawl_syscalls\": %ld, \"syscalls_per_dir\": %.2f,\n",
+               r->syscalls, r->syscalls - base->syscalls,
+               (double)(r->syscalls - base->syscalls) / (double)r->dirs);
+    } else {
+        printf("     \"syscalls\": null, \"crawl_syscalls\": null, \"syscalls_per_dir\": null,\n");
+    }
+    printf("     \"max_rss_kb\": %ld, \"rss_per_watch_bytes\": ", r->max_rss_kb);
+    if (watches > 0) {
+        printf("%.0f}", (double)(r->max_rss_kb - base->max_rss_kb) * 1024.0 / (double)watches);
+    } else {
+        printf("null}");
+    }
+    printf("%s\n", last ? "" : ",");
+}
+
+/**
+ * Print usage information
+ */
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [OPTIONS] FSWATCHER [FSWATCHER_OPTION...]\n", program_name);
+    printf("Options:\n");
+    printf("  -d, --dir=DIR       Scratch directory for the trees (default: %s)\n", DEFAULT_SCRATCH);
+    printf("  -t, --shape=NAME    Only run this shape (wide, deep, files, dirs, balanced;\n");
+    printf("                      may be repeated)\n");
+    printf("  -s, --scale=N       Multiply the files per directory by N (default: 1)\n");
+    printf("  -n, --runs=N        Timed startups per shape; the median is reported (default: 5)\n");
+    printf("  -k, --keep          Leave the generated trees in place\n");
+    printf("  -h, --help          Display this help message\n");
+    printf("\nExtra options are passed to every fswatcher run, e.g. -N or -R 500 to\n");
+    printf("measure the throttled crawl. Results are written to stdout as JSON.\n");
+}
+
+int main(int argc, char **argv) {
+    const char *scratch = DEFAULT_SCRATCH;
+    const char *only[SHAPE_COUNT];
+    int only_count = 0;
+    uint32_t scale = 1;
+    int runs = 5;
+    int keep = 0;
+
+    int opt;
+    static struct option long_options[] = {
+        {"dir",   required_argument, NULL, 'd'},
+        {"shape", required_argument, NULL, 't'},
+        {"scale", required_argument, NULL, 's'},
+        {"runs",  required_argument, NULL, 'n'},
+        {"keep",  no_argument,       NULL, 'k'},
+        {"help",  no_argument,       NULL, 'h'},
+        {NULL,    0,                 NULL, 0}
+    };
+
+    // Stop at FSWATCHER so its options are left alone
+    while ((opt = getopt_long(argc, argv, "+d:t:s:n:kh", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                scratch = optarg;
+                break;
+            case 't':
+                if (only_count < (int)SHAPE_COUNT) {
+                    only[only_count++] = optarg;
+                }
+                break;
+            case 's':
+                scale = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'k':
+                keep = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind >= argc || scale == 0 || runs < 1 || runs > MAX_RUNS) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    watcher_argv = argv + optind;
+    watcher_argc = argc - optind;
+    if (access(watcher_argv[0], X_OK) < 0) {
+        perror(watcher_argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    char base_dir[PATH_MAX];
+    if (snprintf(base_dir, sizeof(base_dir), "%s/crawlbench.%d", scratch, (int)getpid()) >= (int)sizeof(base_dir) ||
+        mkdir(base_dir, 0755) < 0) {
+        fprintf(stderr, "Cannot create scratch directory in %s: %s\n", scratch, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    struct statfs sfs;
+    int on_tmpfs = statfs(base_dir, &sfs) == 0 && (unsigned long)sfs.f_type == TMPFS_MAGIC_NUMBER;
+    if (!on_tmpfs) {
+        fprintf(stderr, "Warning: %s is not tmpfs; results include disk latency\n", scratch);
+    }
+
+    long max_user_watches = -1;
+    FILE *limits = fopen("/proc/sys/fs/inotify/max_user_watches", "r");
+    if (limits) {
+        if (fscanf(limits, "%ld", &max_user_watches) != 1) {
+            max_user_watches = -1;
+        }
+        fclose(limits);
+    }
+    struct utsname uts;
+    if (uname(&uts) < 0) {
+        strcpy(uts.release, "unknown");
+    }
+
+    // The fixed cost of starting up: an empty tree
+    char path[PATH_MAX];
+    tree_result base;
+    memset(&base, 0, sizeof(base));
+    if (snprintf(path, sizeof(path), "%s/empty", base_dir) >= (int)sizeof(path) ||
+        mkdir(path, 0755) < 0 || measure(path, runs, &base) < 0) {
+        fprintf(stderr, "Failed to run %s\n", watcher_argv[0]);
+        remove_tree(base_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("{\n");
+    printf("  \"fswatcher\": \"%s\",\n", watcher_argv[0]);
+    printf("  \"kernel\": \"%s\",\n", uts.release);
+    printf("  \"tmpfs\": %s,\n", on_tmpfs ? "true" : "false");
+    printf("  \"max_user_watches\": %ld,\n", max_user_watches);
+    printf("  \"scale\": %u,\n", scale);
+    printf("  \"runs\": %d,\n", runs);
+    printf("  \"baseline\": {\"startup_ms\": %.3f, \"syscalls\": %ld, \"max_rss_kb\": %ld},\n",
+           base.wall_ms, base.syscalls, base.max_rss_kb);
+    printf("  \"shapes\": [\n");
+
+    int status = EXIT_SUCCESS;
+    int selected[SHAPE_COUNT];
+    int remaining = 0;
+    for (size_t s = 0; s < SHAPE_COUNT; s++) {
+        selected[s] = only_count == 0;
+        for (int i = 0; i < only_count; i++) {
+            if (strcmp(only[i], shapes[s].name) == 0) {
+                selected[s] = 1;
+            }
+        }
+        remaining += selected[s];
+    }
+
+    for (size_t s = 0; s < SHAPE_COUNT; s++) {
+        if (!selected[s]) {
+            continue;
+        }
+        const tree_shape *shape = &shapes[s];
+        tree_result r;
+        memset(&r, 0, sizeof(r));
+
+        int len = snprintf(path, sizeof(path), "%s/%s", base_dir, shape->name);
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (generate(path, (size_t)len, shape, 0, shape->files_per_dir * scale, &r) < 0) {
+            fprintf(stderr, "Failed to generate %s tree: %s\n", shape->name, strerror(errno));
+            status = EXIT_FAILURE;
+            break;
+        }
+        r.generate_ms = elapsed_ms(&start);
+
+        path[len] = '\0';
+        fprintf(stderr, "%s: %llu directories, %llu files\n", shape->name,
+                (unsigned long long)r.dirs, (unsigned long long)r.files);
+        if (measure(path, runs, &r) < 0) {
+            fprintf(stderr, "Failed to run %s on the %s tree\n", watcher_argv[0], shape->name);
+            status = EXIT_FAILURE;
+            break;
+        }
+        print_json_result(shape->name, &r, &base, --remaining == 0);
+        if (!crawl_complete(&r, &base)) {
+            fprintf(stderr, "%s: only %ld of %llu directories were watched (MAX_WATCHES?); "
+                    "the numbers describe a truncated crawl\n", shape->name,
+                    r.watches - base.watches + 1, (unsigned long long)r.dirs);
+            status = EXIT_FAILURE;
+        }
+
+        if (!keep) {
+            remove_tree(path);
+        }
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+
+    if (!keep) {
+        remove_tree(base_dir);
+    }
+    return status;
+}
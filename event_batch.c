@@ -0,0 +1,55 @@
+// event_batch.c
+#include "event_batch.h"
+#include <string.h>
+#include <sys/inotify.h>
+
+// Length of a NUL-padded name. The kernel pads names with zeros to the
+// record length, so eight bytes can be tested for a zero at a time.
+static uint16_t name_length(const char *name, uint32_t field) {
+    uint32_t i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    for (; i + 8 <= field; i += 8) {
+        uint64_t v;
+        memcpy(&v, name + i, 8);
+        uint64_t zero = (v - ones) & ~v & high;  // Exact for the lowest zero byte
+        if (zero) {
+            return (uint16_t)(i + (uint32_t)(__builtin_ctzll(zero) >> 3));
+        }
+    }
+#endif
+    while (i < field && name[i]) {
+        i++;
+    }
+    return (uint16_t)i;
+}
+
+size_t event_batch_decode(event_batch *b, const char *buf, size_t len) {
+    size_t off = 0;
+    uint32_t n = 0;
+
+    while (n < EVENT_BATCH_MAX && off + sizeof(struct inotify_event) <= len) {
+        struct inotify_event ev;
+        memcpy(&ev, buf + off, sizeof(ev));
+
+        size_t name_off = off + sizeof(struct inotify_event);
+        if (name_off + ev.len > len) {
+            break;
+        }
+
+        b->wd[n] = ev.wd;
+        b->mask[n] = ev.mask;
+        b->cookie[n] = ev.cookie;
+        b->record[n] = (uint32_t)off;
+        b->name[n] = (uint32_t)name_off;
+        b->name_len[n] = name_length(buf + name_off, ev.len);
+        n++;
+
+        off = name_off + ev.len;
+    }
+
+    b->count = n;
+    return off;
+}
@@ -0,0 +1,25 @@
+// event_batch.h
+#ifndef EVENT_BATCH_H
+#define EVENT_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_BATCH_MAX 2048    // Records in a batch (a 32K buffer of name-less events)
+
+// One read() buffer decoded column by column
+typedef struct {
+    uint32_t count;
+    int32_t wd[EVENT_BATCH_MAX];
+    uint32_t mask[EVENT_BATCH_MAX];
+    uint32_t cookie[EVENT_BATCH_MAX];
+    uint32_t record[EVENT_BATCH_MAX];       // Offset of the raw record in the buffer
+    uint32_t name[EVENT_BATCH_MAX];         // Offset of the name in the buffer
+    uint16_t name_len[EVENT_BATCH_MAX];     // strlen of the name (0 = none)
+} event_batch;
+
+// Decode raw inotify records from buf into b in one pass. Stops when the
+// batch is full or at a truncated record; returns the bytes consumed.
+size_t event_batch_decode(event_batch *b, const char *buf, size_t len);
+
+#endif // EVENT_BATCH_H
@@ -0,0 +1,70 @@
+// event_bench.c
+#include "event_bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+
+// Relative weights of each event type (out of 100)
+static const struct {
+    uint32_t mask;
+    int weight;
+} event_mix[] = {
+    { IN_MODIFY,      50 },
+    { IN_CREATE,      18 },
+    { IN_DELETE,      14 },
+    { IN_MOVED_FROM,   5 },
+    { IN_MOVED_TO,     5 },
+    { IN_ATTRIB,       8 }
+};
+
+static const char *extensions[] = { ".c", ".h", ".o", ".log", ".txt", ".tmp", ".swp", ".json" };
+
+// xorshift64*: cheap and deterministic so every run replays the same workload
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state ? *state : 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+size_t bench_fill_buffer(char *buf, size_t len, const int *wds, int wd_count, uint64_t *seq) {
+    size_t used = 0;
+
+    for (;;) {
+        uint64_t r = next_random(seq);
+        char name[64];
+        int name_len = snprintf(name, sizeof(name), "file%05u%s",
+                                (unsigned)(r % 20000),
+                                extensions[(r >> 16) % (sizeof(extensions) / sizeof(extensions[0]))]);
+
+        // Names are NUL padded to a multiple of 16 like the kernel does
+        uint32_t padded = (uint32_t)((name_len + 1 + 15) & ~15);
+        size_t record = sizeof(struct inotify_event) + padded;
+        if (used + record > len) {
+            break;
+        }
+
+        int pick = (int)((r >> 32) % 100);
+        uint32_t mask = event_mix[0].mask;
+        for (size_t i = 0; i < sizeof(event_mix) / sizeof(event_mix[0]); i++) {
+            if (pick < event_mix[i].weight) {
+                mask = event_mix[i].mask;
+                break;
+            }
+            pick -= event_mix[i].weight;
+        }
+
+        struct inotify_event *event = (struct inotify_event *)(buf + used);
+        event->wd = wds[(r >> 40) % (uint64_t)wd_count];
+        event->mask = mask;
+        event->cookie = (mask & (IN_MOVED_FROM | IN_MOVED_TO)) ? (uint32_t)(r >> 48) : 0;
+        event->len = padded;
+        memset(event->name, 0, padded);
+        memcpy(event->name, name, (size_t)name_len);
+
+        used += record;
+    }
+    return used;
+}
@@ -0,0 +1,14 @@
+// event_bench.h
+#ifndef EVENT_BENCH_H
+#define EVENT_BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fill buf with synthetic inotify records spread over the given watch
+// descriptors. The mix of event types and filenames follows a typical
+// source-tree workload. seq carries the generator state between calls.
+// Returns the number of bytes used.
+size_t bench_fill_buffer(char *buf, size_t len, const int *wds, int wd_count, uint64_t *seq);
+
+#endif // EVENT_BENCH_H
@@ -0,0 +1,378 @@
+// executor.c
+#include "executor.h"
+#include "hash_utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#define NOT_BUSY            UINT64_MAX
+#define RESTART_BACKOFF_MS  10          // First delay after a crash right at startup
+#define RESTART_BACKOFF_MAX 5000
+#define STABLE_MS           1000        // A helper that lived this long crashed "late"
+
+// Shared with the helper. Producer and consumer fields sit on separate
+// cache lines so the two processes don't keep stealing one line.
+typedef struct {
+    uint64_t head;              // Bytes published (daemon)
+    char pad1[56];
+    uint64_t tail;              // Bytes consumed (helper)
+    uint64_t busy;              // Offset of the record running now
+    uint64_t delivered;         // Events run
+    uint32_t stop;              // Drain and exit
+    char pad2[36];
+} ring_header;
+
+// In the ring: a header, then path and name, padded to 8 bytes. A record
+// with no callbacks is padding up to the end of the ring.
+typedef struct {
+    uint32_t len;
+    uint32_t mask;
+    uint32_t callbacks;
+    uint32_t path_id;
+    uint32_t name_id;
+    uint16_t path_len;
+    uint16_t name_len;
+    uint64_t file_id;
+} ring_record;
+
+typedef struct {
+    ring_header *ring;
+    char *data;
+    int wake_fd;
+    pid_t pid;                  // 0 while waiting to be restarted
+    int pending_wake;
+    uint64_t started_ms;
+    uint64_t restart_at_ms;
+    uint32_t backoff_ms;
+    uint64_t submitted;
+    uint64_t dropped;
+    uint64_t crashes;
+    uint64_t skipped;
+    uint64_t rate_delivered;    // delivered at the last report
+    uint64_t rate_ms;
+} executor;
+
+static executor *executors = NULL;
+static int count = 0;
+static size_t ring_size = 0;
+static executor_run_fn run_event = NULL;
+static executor_child_fn child_setup = NULL;
+static int is_helper = 0;
+static volatile sig_atomic_t child_exited = 0;
+
+static uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void on_sigchld(int sig) {
+    (void)sig;
+    child_exited = 1;
+}
+
+// Body of a helper process: run records until told to stop
+static void helper_main(executor *e, pid_t parent) {
+    is_helper = 1;
+    if (child_setup) {
+        child_setup();
+    }
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != parent) {
+        _exit(0);  // The daemon died before the death signal was armed
+    }
+
+    ring_header *h = e->ring;
+    uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+    while (1) {
+        uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            if (__atomic_load_n(&h->stop, __ATOMIC_ACQUIRE)) {
+                fflush(NULL);
+                _exit(0);
+            }
+            fflush(stdout);
+            uint64_t value;
+            if (read(e->wake_fd, &value, sizeof(value)) < 0 && errno != EINTR) {
+                _exit(1);
+            }
+            continue;
+        }
+
+        size_t pos = (size_t)(tail & (ring_size - 1));
+        if (ring_size - pos < sizeof(ring_record)) {
+            tail += ring_size - pos;  // Too short for a header: wrap
+            __atomic_store_n(&h->tail, tail, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        const ring_record *rec = (const ring_record *)(e->data + pos);
+        if (rec->callbacks) {
+            executor_event ev;
+            ev.mask = rec->mask;
+            ev.callbacks = rec->callbacks;
+            ev.path_id = rec->path_id;
+            ev.name_id = rec->name_id;
+            ev.file_id = rec->file_id;
+            ev.path = (const char *)(rec + 1);
+            ev.name = ev.path + rec->path_len + 1;
+
+            __atomic_store_n(&h->busy, tail, __ATOMIC_RELEASE);
+            run_event(&ev);
+            __atomic_store_n(&h->busy, NOT_BUSY, __ATOMIC_RELEASE);
+            __atomic_store_n(&h->delivered, h->delivered + 1, __ATOMIC_RELEASE);
+        }
+        tail += rec->len;
+        __atomic_store_n(&h->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+static int spawn(executor *e) {
+    pid_t parent = getpid();
+    fflush(NULL);  // Don't let the helper inherit (and repeat) buffered output
+    __atomic_store_n(&e->ring->stop, 0, __ATOMIC_RELEASE);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        helper_main(e, parent);
+    }
+    e->pid = pid;
+    e->started_ms = monotonic_ms();
+    return 0;
+}
+
+int executor_start(int n, size_t ring_bytes, executor_run_fn run, executor_child_fn child_init) {
+    if (n <= 0 || ring_bytes < 4096 || (ring_bytes & (ring_bytes - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    executors = calloc((size_t)n, sizeof(*executors));
+    if (!executors) {
+        return -1;
+    }
+    ring_size = ring_bytes;
+    run_event = run;
+    child_setup = child_init;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    for (int i = 0; i < n; i++) {
+        executor *e = &executors[i];
+        void *shm = mmap(NULL, sizeof(ring_header) + ring_bytes, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (shm == MAP_FAILED) {
+            return -1;
+        }
+        e->ring = shm;
+        e->data = (char *)shm + sizeof(ring_header);
+        e->ring->busy = NOT_BUSY;
+        e->backoff_ms = RESTART_BACKOFF_MS;
+        e->rate_ms = monotonic_ms();
+        e->wake_fd = eventfd(0, EFD_CLOEXEC);
+        count = i + 1;
+        if (e->wake_fd < 0 || spawn(e) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int executor_is_helper() {
+    return is_helper;
+}
+
+int executor_count() {
+    return count;
+}
+
+int executor_submit(const executor_event *ev) {
+    executor *e = &executors[count > 1 ? fnv1a_str(ev->path) % (uint64_t)count : 0];
+    size_t path_len = strlen(ev->path);
+    size_t name_len = strlen(ev->name);
+    size_t len = (sizeof(ring_record) + path_len + name_len + 2 + 7) & ~(size_t)7;
+    if (path_len > UINT16_MAX || name_len > UINT16_MAX || len > ring_size / 2) {
+        e->dropped++;
+        return -1;
+    }
+
+    ring_header *h = e->ring;
+    uint64_t head = h->head;
+    uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+    size_t pos = (size_t)(head & (ring_size - 1));
+    size_t pad = ring_size - pos < len ? ring_size - pos : 0;
+    if (head + pad + len - tail > ring_size) {
+        e->dropped++;  // The helper is too far behind; never stall the daemon
+        return -1;
+    }
+
+    if (pad) {
+        if (pad >= sizeof(ring_record)) {
+            ring_record *filler = (ring_record *)(e->data + pos);
+            memset(filler, 0, sizeof(*filler));
+            filler->len = (uint32_t)pad;
+        }
+        pos = 0;
+    }
+
+    ring_record *rec = (ring_record *)(e->data + pos);
+    rec->len = (uint32_t)len;
+    rec->mask = ev->mask;
+    rec->callbacks = ev->callbacks;
+    rec->path_id = ev->path_id;
+    rec->name_id = ev->name_id;
+    rec->path_len = (uint16_t)path_len;
+    rec->name_len = (uint16_t)name_len;
+    rec->file_id = ev->file_id;
+    char *text = (char *)(rec + 1);
+    memcpy(text, ev->path, path_len + 1);
+    memcpy(text + path_len + 1, ev->name, name_len + 1);
+
+    __atomic_store_n(&h->head, head + pad + len, __ATOMIC_RELEASE);
+    e->submitted++;
+    e->pending_wake = 1;
+
+    // Don't let a huge batch fill the ring before the helper starts on it
+    if (head + pad + len - tail > ring_size / 2) {
+        executor_flush();
+    }
+    return 0;
+}
+
+void executor_flush() {
+    for (int i = 0; i < count; i++) {
+        executor *e = &executors[i];
+        if (e->pending_wake && e->pid > 0) {
+            uint64_t one = 1;
+            if (write(e->wake_fd, &one, sizeof(one)) == sizeof(one)) {
+                e->pending_wake = 0;
+            }
+        }
+    }
+}
+
+void executor_reap(executor_exit_fn report) {
+    uint64_t now = 0;
+
+    if (child_exited) {
+        child_exited = 0;
+        now = monotonic_ms();
+        for (int i = 0; i < count; i++) {
+            executor *e = &executors[i];
+            int status;
+            if (e->pid <= 0 || waitpid(e->pid, &status, WNOHANG) != e->pid) {
+                continue;
+            }
+
+            // Step over the event it died on
+            ring_header *h = e->ring;
+            int skipped = 0;
+            uint64_t busy = __atomic_load_n(&h->busy, __ATOMIC_ACQUIRE);
+            if (busy != NOT_BUSY) {
+                const ring_record *rec = (const ring_record *)(e->data + (busy & (ring_size - 1)));
+                h->tail = busy + rec->len;
+                h->busy = NOT_BUSY;
+                e->skipped++;
+                skipped = 1;
+            }
+
+            e->crashes++;
+            if (now - e->started_ms < STABLE_MS) {
+                e->restart_at_ms = now + e->backoff_ms;
+                e->backoff_ms = e->backoff_ms * 2 > RESTART_BACKOFF_MAX ? RESTART_BACKOFF_MAX : e->backoff_ms * 2;
+            } else {
+                e->restart_at_ms = now;
+                e->backoff_ms = RESTART_BACKOFF_MS;
+            }
+            report(i, (int)e->pid, status, skipped);
+            e->pid = 0;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        executor *e = &executors[i];
+        if (e->pid == 0) {
+            if (!now) {
+                now = monotonic_ms();
+            }
+            if (now >= e->restart_at_ms && spawn(e) == 0) {
+                e->pending_wake = 1;  // Pick up whatever queued meanwhile
+            }
+        }
+    }
+}
+
+void executor_report(FILE *out) {
+    uint64_t now = monotonic_ms();
+    for (int i = 0; i < count; i++) {
+        executor *e = &executors[i];
+        uint64_t delivered = __atomic_load_n(&e->ring->delivered, __ATOMIC_ACQUIRE);
+        uint64_t queued = __atomic_load_n(&e->ring->head, __ATOMIC_ACQUIRE) -
+                          __atomic_load_n(&e->ring->tail, __ATOMIC_ACQUIRE);
+        double seconds = (double)(now - e->rate_ms) / 1000.0;
+        double rate = seconds > 0 ? (double)(delivered - e->rate_delivered) / seconds : 0;
+        e->rate_delivered = delivered;
+        e->rate_ms = now;
+
+        fprintf(out, "%d pid %d submitted %llu delivered %llu rate %.0f/s queued_bytes %llu "
+                "dropped %llu crashes %llu skipped %llu\n",
+                i, (int)e->pid, (unsigned long long)e->submitted, (unsigned long long)delivered,
+                rate, (unsigned long long)queued, (unsigned long long)e->dropped,
+                (unsigned long long)e->crashes, (unsigned long long)e->skipped);
+    }
+}
+
+void executor_stop() {
+    if (is_helper) {
+        return;  // Only the daemon owns the helpers
+    }
+    signal(SIGCHLD, SIG_DFL);
+    for (int i = 0; i < count; i++) {
+        executor *e = &executors[i];
+        if (e->pid > 0) {
+            __atomic_store_n(&e->ring->stop, 1, __ATOMIC_RELEASE);
+            e->pending_wake = 1;
+        }
+    }
+    executor_flush();
+
+    for (int i = 0; i < count; i++) {
+        executor *e = &executors[i];
+        for (int waited = 0; e->pid > 0 && waited < 100; waited++) {
+            if (waitpid(e->pid, NULL, WNOHANG) == e->pid) {
+                e->pid = 0;
+                break;
+            }
+            usleep(10000);
+        }
+        if (e->pid > 0) {
+            kill(e->pid, SIGKILL);
+            waitpid(e->pid, NULL, 0);
+        }
+        if (e->wake_fd >= 0) {
+            close(e->wake_fd);
+        }
+        munmap(e->ring, sizeof(ring_header) + ring_size);
+    }
+    free(executors);
+    executors = NULL;
+    count = 0;
+}
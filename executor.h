@@ -0,0 +1,65 @@
+// executor.h
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// One event as handed to a helper process. Everything that needs the
+// daemon's state (routing, pattern matching, ids) is resolved before the
+// handoff, so the helper only runs callbacks.
+typedef struct {
+    uint32_t mask;
+    uint32_t callbacks;         // Callback slots to run (bitmap)
+    uint32_t path_id;           // Interned ids, if a callback wants them
+    uint32_t name_id;
+    uint64_t file_id;
+    const char *path;
+    const char *name;
+} executor_event;
+
+// Runs one event inside a helper process
+typedef void (*executor_run_fn)(const executor_event *ev);
+
+// Runs first thing in every new helper: drop what the daemon owns (its
+// inotify descriptor, listening sockets) so a helper can never act on it
+typedef void (*executor_child_fn)();
+
+// Called from executor_reap() when a helper died and was (or will be)
+// restarted; skipped is 1 if the event it was running was dropped
+typedef void (*executor_exit_fn)(int index, int pid, int status, int skipped);
+
+// Fork count helper processes running run(), each fed by a single-producer
+// ring of ring_bytes (a power of two) in shared memory. Callbacks must be
+// registered before this: helpers see the registry as it was at fork.
+int executor_start(int count, size_t ring_bytes, executor_run_fn run, executor_child_fn child_init);
+
+// Is this process a helper? Helpers inherit the daemon's atexit handlers,
+// which must do nothing if a callback calls exit().
+int executor_is_helper();
+
+// Number of helpers (0 = callbacks run inline)
+int executor_count();
+
+// Copy an event into the ring of the helper owning its directory, so
+// events for one directory stay in order. Never blocks: returns -1 and
+// counts a drop if the ring is full.
+int executor_submit(const executor_event *ev);
+
+// Wake helpers that were handed events since the last flush; one wakeup
+// per batch rather than per event
+void executor_flush();
+
+// Collect helpers that died and restart them, backing off if they keep
+// crashing right after starting. The event a helper was running when it
+// died is skipped so one poisonous event cannot crash it forever.
+void executor_reap(executor_exit_fn report);
+
+// One line of counters per helper
+void executor_report(FILE *out);
+
+// Let helpers drain their rings and exit (killed after a second)
+void executor_stop();
+
+#endif // EXECUTOR_H
@@ -0,0 +1,211 @@
+// file_id.c
+#include "file_id.h"
+#include "hash_utils.h"
+#include "path_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define NO_SLOT UINT32_MAX
+#define RENAMES 16              // Rename sources awaiting their target
+
+// Ids live in a flat array indexed by the path map's 32-bit values;
+// freed slots are chained through the array itself
+static uint64_t *ids = NULL;
+static uint32_t id_count = 0;
+static uint32_t id_cap = 0;
+static uint32_t free_slots = NO_SLOT;
+static path_map id_slots;
+static uint64_t lookups = 0;
+static uint64_t resolved = 0;
+
+// Ids of recent rename sources by cookie, so the target needs no syscall
+static struct {
+    uint32_t cookie;
+    uint64_t id;
+} renames[RENAMES];
+static uint32_t rename_next = 0;
+
+int file_id_init() {
+    file_id_cleanup();
+    return path_map_init(&id_slots, 1024);
+}
+
+// Ask the kernel who name (relative to dir_fd) is; falls back to device
+// and inode where the filesystem can't produce handles
+static uint64_t resolve_at(int dir_fd, const char *name) {
+    uint64_t storage[(sizeof(struct file_handle) + MAX_HANDLE_SZ) / sizeof(uint64_t) + 1];
+    struct file_handle *fh = (struct file_handle *)storage;
+    int mount_id;
+    uint64_t id;
+
+    resolved++;
+    fh->handle_bytes = MAX_HANDLE_SZ;
+    if (name_to_handle_at(dir_fd, name, fh, &mount_id, 0) == 0) {
+        uint64_t seed = ((uint64_t)(uint32_t)mount_id << 32) | (uint32_t)fh->handle_type;
+        id = xxh64(fh->f_handle, fh->handle_bytes, seed);
+    } else {
+        struct stat st;
+        if (errno == ENOENT || errno == ENOTDIR || fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            return FILE_ID_NONE;
+        }
+        uint64_t fields[2] = { (uint64_t)st.st_dev, (uint64_t)st.st_ino };
+        id = xxh64(fields, sizeof(fields), 0);
+    }
+    return id != FILE_ID_NONE ? id : 1;
+}
+
+static uint64_t resolve(const char *path) {
+    return resolve_at(AT_FDCWD, path);
+}
+
+static void cache_put(const char *path, uint64_t id) {
+    uint32_t slot;
+    if (path_map_get(&id_slots, path, &slot)) {
+        ids[slot] = id;
+        return;
+    }
+
+    if (free_slots != NO_SLOT) {
+        slot = free_slots;
+        free_slots = (uint32_t)ids[slot];
+    } else {
+        if (id_count == id_cap) {
+            uint32_t cap = id_cap ? id_cap * 2 : 1024;
+            uint64_t *grown = realloc(ids, cap * sizeof(*ids));
+            if (!grown) {
+                return;  // Uncached: the next event resolves again
+            }
+            ids = grown;
+            id_cap = cap;
+        }
+        slot = id_count++;
+    }
+
+    ids[slot] = id;
+    if (path_map_put(&id_slots, path, slot) < 0) {
+        ids[slot] = free_slots;
+        free_slots = slot;
+    }
+}
+
+static void release_slot(uint32_t slot, void *arg) {
+    (void)arg;
+    ids[slot] = free_slots;
+    free_slots = slot;
+}
+
+int file_id_seed_dir(const char *dir, file_id_filter filter) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    int seeded = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            (filter && !filter(entry->d_name))) {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        uint64_t id = resolve_at(dirfd(d), entry->d_name);
+        if (id != FILE_ID_NONE) {
+            cache_put(path, id);
+            seeded++;
+        }
+    }
+    closedir(d);
+    return seeded;
+}
+
+uint64_t file_id_for_event(const char *path, uint32_t mask, uint32_t cookie) {
+    uint32_t slot;
+    lookups++;
+
+    // The other half of a rename we saw: same file, already known
+    if ((mask & IN_MOVED_TO) && cookie) {
+        for (int i = 0; i < RENAMES; i++) {
+            if (renames[i].cookie == cookie) {
+                uint64_t id = renames[i].id;
+                renames[i].cookie = 0;
+                cache_put(path, id);
+                return id;
+            }
+        }
+    }
+
+    // A new name may be a different file than the one cached under it
+    if (mask & (IN_CREATE | IN_MOVED_TO)) {
+        uint64_t id = resolve(path);
+        if (id != FILE_ID_NONE) {
+            cache_put(path, id);
+        }
+        return id;
+    }
+
+    // Whatever was cached below a directory that went away is stale
+    if ((mask & IN_ISDIR) && (mask & (IN_DELETE | IN_MOVED_FROM))) {
+        char below[PATH_MAX];
+        if (snprintf(below, sizeof(below), "%s/", path) < (int)sizeof(below)) {
+            path_map_remove_tree(&id_slots, below, release_slot, NULL);
+        }
+    }
+
+    if (!path_map_get(&id_slots, path, &slot)) {
+        if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+            return FILE_ID_NONE;  // Gone from path before we ever saw it there
+        }
+        uint64_t id = resolve(path);
+        if (id != FILE_ID_NONE) {
+            cache_put(path, id);
+        }
+        return id;
+    }
+
+    uint64_t id = ids[slot];
+    if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        path_map_remove(&id_slots, path);
+        release_slot(slot, NULL);
+    }
+    if ((mask & IN_MOVED_FROM) && cookie) {
+        renames[rename_next].cookie = cookie;
+        renames[rename_next].id = id;
+        rename_next = (rename_next + 1) % RENAMES;
+    }
+    return id;
+}
+
+void file_id_forget_tree(const char *root) {
+    // root itself stays: it is still an entry of its (maybe watched) parent
+    char below[PATH_MAX];
+    if (snprintf(below, sizeof(below), "%s/", root) < (int)sizeof(below)) {
+        path_map_remove_tree(&id_slots, below, release_slot, NULL);
+    }
+}
+
+void file_id_stats(uint32_t *cached, uint64_t *lookup_count, uint64_t *resolved_count) {
+    *cached = id_slots.count;
+    *lookup_count = lookups;
+    *resolved_count = resolved;
+}
+
+void file_id_cleanup() {
+    free(ids);
+    path_map_free(&id_slots);
+    ids = NULL;
+    id_count = id_cap = 0;
+    free_slots = NO_SLOT;
+    lookups = resolved = 0;
+    memset(renames, 0, sizeof(renames));
+    rename_next = 0;
+}
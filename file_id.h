@@ -0,0 +1,41 @@
+// file_id.h
+#ifndef FILE_ID_H
+#define FILE_ID_H
+
+#include <stdint.h>
+
+#define FILE_ID_NONE 0          // Identity unknown (file already gone)
+
+// Start with an empty cache
+int file_id_init();
+
+// Which names to seed (1 = seed); names whose events never reach the
+// cache should not be cached either
+typedef int (*file_id_filter)(const char *filename);
+
+// Cache the ids of the entries in dir that pass filter (one
+// name_to_handle_at each), so files that existed before any event still
+// have an id when they are renamed or deleted. Returns the number of
+// entries cached, or -1.
+int file_id_seed_dir(const char *dir, file_id_filter filter);
+
+// Stable id of the file at path as of an event with the given inotify
+// mask and rename cookie. The id hashes the kernel file handle (inode and
+// generation on most filesystems, plus the mount), so it survives renames
+// and is not reused when an inode number is recycled. Paths seen before
+// are answered from the cache, and a rename target takes the id of its
+// source by cookie; other new names (creates, files moved in) cost one
+// name_to_handle_at. Deletes and rename sources drop the cached entry,
+// and for a directory everything cached below it.
+uint64_t file_id_for_event(const char *path, uint32_t mask, uint32_t cookie);
+
+// Drop every cached id below root (a root no longer watched)
+void file_id_forget_tree(const char *root);
+
+// Cache statistics: cached paths, lookups, and lookups that needed a syscall
+void file_id_stats(uint32_t *cached, uint64_t *lookups, uint64_t *resolved);
+
+// Release the cache
+void file_id_cleanup();
+
+#endif // FILE_ID_H
@@ -0,0 +1,94 @@
+/**
+ * fsdiff - compare two Merkle tree snapshots written by fswatcher
+ *
+ * The walk starts at the roots and only descends into directories whose
+ * hashes differ, so identical replicas compare in one step and a single
+ * changed file costs one directory listing per level above it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "merkle.h"
+
+/**
+ * Print one difference in a diff -q like form
+ */
+static void print_difference(const char *path, merkle_diff_kind kind, void *arg) {
+    const char **names = arg;
+
+    switch (kind) {
+        case MERKLE_ONLY_A:
+            printf("Only in %s: %s\n", names[0], path);
+            break;
+        case MERKLE_ONLY_B:
+            printf("Only in %s: %s\n", names[1], path);
+            break;
+        case MERKLE_DIFFERS:
+            printf("Differs: %s\n", path);
+            break;
+    }
+}
+
+/**
+ * Print usage information
+ */
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [OPTIONS] SNAPSHOT_A SNAPSHOT_B\n", program_name);
+    printf("Options:\n");
+    printf("  -q, --quiet     Only set the exit status (0 = identical, 1 = different)\n");
+    printf("  -h, --help      Display this help message\n");
+}
+
+int main(int argc, char **argv) {
+    int quiet = 0;
+
+    int opt;
+    static struct option long_options[] = {
+        {"quiet", no_argument, NULL, 'q'},
+        {"help",  no_argument, NULL, 'h'},
+        {NULL,    0,           NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "qh", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'q':
+                quiet = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(2);
+        }
+    }
+
+    if (argc - optind != 2) {
+        print_usage(argv[0]);
+        exit(2);
+    }
+
+    const char *names[2] = { argv[optind], argv[optind + 1] };
+    merkle_view a, b;
+    if (merkle_view_open(&a, names[0]) < 0) {
+        perror(names[0]);
+        exit(2);
+    }
+    if (merkle_view_open(&b, names[1]) < 0) {
+        perror(names[1]);
+        merkle_view_close(&a);
+        exit(2);
+    }
+
+    uint32_t differences;
+    if (quiet) {
+        differences = !merkle_view_equal(&a, &b);
+    } else {
+        differences = merkle_diff(&a, &b, print_difference, names);
+    }
+
+    merkle_view_close(&a);
+    merkle_view_close(&b);
+    return differences ? EXIT_FAILURE : EXIT_SUCCESS;
+}
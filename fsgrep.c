@@ -0,0 +1,167 @@
+/**
+ * fsgrep - search files using the trigram index maintained by fswatcher
+ *
+ * The index narrows the search to files containing every trigram of the
+ * query; only those candidates are opened and scanned for the literal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trigram_index.h"
+
+// Search options and counters shared with the candidate callback
+typedef struct {
+    const char *query;
+    size_t query_len;
+    int list_only;
+    unsigned long matched_files;
+} search_state;
+
+/**
+ * Scan one candidate file for the literal and print matching lines
+ */
+static int scan_candidate(const char *path, void *arg) {
+    search_state *s = arg;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;  // Deleted since the index was written
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    size_t len = (size_t)st.st_size;
+    char *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    int found = 0;
+    const char *p = data;
+    const char *end = data + len;
+    unsigned long line = 1;
+    const char *line_start = data;
+
+    while (p < end) {
+        const char *hit = memmem(p, (size_t)(end - p), s->query, s->query_len);
+        if (!hit) {
+            break;
+        }
+        found = 1;
+        if (s->list_only) {
+            break;
+        }
+
+        // Count lines up to the hit and print the whole line once
+        for (const char *c = line_start; c < hit; c++) {
+            if (*c == '\n') {
+                line++;
+                line_start = c + 1;
+            }
+        }
+        const char *line_end = memchr(hit, '\n', (size_t)(end - hit));
+        if (!line_end) {
+            line_end = end;
+        }
+        printf("%s:%lu:%.*s\n", path, line, (int)(line_end - line_start), line_start);
+
+        p = line_end + 1;
+        if (line_end < end) {
+            line++;
+            line_start = p;
+        }
+    }
+
+    if (found) {
+        s->matched_files++;
+        if (s->list_only) {
+            printf("%s\n", path);
+        }
+    }
+
+    munmap(data, len);
+    return 0;
+}
+
+/**
+ * Print usage information
+ */
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [OPTIONS] INDEX_FILE STRING\n", program_name);
+    printf("Options:\n");
+    printf("  -l, --files-with-matches  Print only names of matching files\n");
+    printf("  -s, --stats               Print index narrowing statistics to stderr\n");
+    printf("  -h, --help                Display this help message\n");
+}
+
+int main(int argc, char **argv) {
+    search_state state;
+    int show_stats = 0;
+
+    memset(&state, 0, sizeof(state));
+
+    int opt;
+    static struct option long_options[] = {
+        {"files-with-matches", no_argument, NULL, 'l'},
+        {"stats",              no_argument, NULL, 's'},
+        {"help",               no_argument, NULL, 'h'},
+        {NULL,                 0,           NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "lsh", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'l':
+                state.list_only = 1;
+                break;
+            case 's':
+                show_stats = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind != 2) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *index_file = argv[optind];
+    state.query = argv[optind + 1];
+    state.query_len = strlen(state.query);
+    if (state.query_len == 0) {
+        fprintf(stderr, "Error: empty search string\n");
+        exit(EXIT_FAILURE);
+    }
+
+    trigram_view view;
+    if (trigram_view_open(&view, index_file) < 0) {
+        perror(index_file);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t candidates = trigram_view_candidates(&view, state.query, scan_candidate, &state);
+
+    if (show_stats) {
+        fprintf(stderr, "%u indexed files, %u candidates, %lu matched\n",
+                trigram_view_live_files(&view), candidates, state.matched_files);
+    }
+
+    trigram_view_close(&view);
+    return state.matched_files ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -11,6 +11,7 @@
 #include <sys/types.h>
 #include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
 #include <fnmatch.h>
@@ -19,28 +20,89 @@
 #include <dirent.h>
 #include <limits.h>
 #include <ftw.h>
+#include <poll.h>
+#include <time.h>
 #include "daemon_utils.h"
+#include "integrity.h"
+#include "trigram_index.h"
+#include "git_guard.h"
+#include "priority_lanes.h"
+#include "summary.h"
+#include "sampling.h"
+#include "event_bench.h"
+#include "pattern_cache.h"
+#include "merkle.h"
+#include "usage.h"
+#include "file_id.h"
+#include "scrub.h"
+#include "path_radix.h"
+#include "control.h"
+#include "crawl_throttle.h"
+#include "backlog.h"
+#include "event_batch.h"
+#include "intern.h"
+#include "timer_wheel.h"
+#include "executor.h"
+
+// Build-time features; lean builds set these to 0 to compile them out
+#ifndef FSW_EVENT_CONSOLE
+#define FSW_EVENT_CONSOLE 1             // Print each event in foreground mode
+#endif
+#ifndef FSW_EVENT_SYSLOG
+#define FSW_EVENT_SYSLOG 1              // Log each event to syslog in daemon mode
+#endif
+#ifndef FSW_EXAMPLE_CALLBACKS
+#define FSW_EXAMPLE_CALLBACKS 1         // Register the example callbacks
+#endif
+
+// Watch table size; build with -DMAX_WATCHES=N for bigger trees. Its
+// pages are only touched as watches are added.
+#ifndef MAX_WATCHES
+#define MAX_WATCHES 512
+#endif
 
 #define EVENT_SIZE  (sizeof(struct inotify_event))
 #define BUF_LEN     (1024 * (EVENT_SIZE + 16))
-#define MAX_CALLBACKS 20
+#define MAX_CALLBACKS 20                // At most 32: callback sets are uint32_t bitmaps
 #define DEFAULT_PID_FILE "/var/run/fswatcher.pid"
-#define MAX_WATCHES 512
+#define DEFAULT_WATCH_MASK (IN_CREATE | IN_MODIFY | IN_DELETE | \
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)
+#define OUTPUT_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO)
+#define SETTLE_EVENTS (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB)
+#define TREE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                     IN_CLOSE_WRITE | IN_ATTRIB)   // Merkle tree and disk usage upkeep
+#define TICK_MS 1000                    // Wake-up interval for periodic tasks
+#define INDEX_SAVE_INTERVAL 5           // Seconds between trigram index saves
+#define LANE_BATCH 256                  // Queued events handled between kernel reads
+#define SAMPLE_REPORT_INTERVAL 60       // Seconds between sampling statistics
+#define SCRUB_SLICE_MS 10             // Longest scrub burst per loop iteration
+#define EXECUTOR_RING_BYTES (1 << 20) // Shared-memory event ring per executor
+#define BENCH_BUFFERS 64                // Distinct synthetic read() buffers replayed
 
 // Watch descriptor mapping
 typedef struct {
     int wd;                 // Watch descriptor
+    uint32_t interest;      // Event types some consumer may act on (0 = none can match)
     char path[PATH_MAX];    // Full path being watched
 } watch_info;
 
 // Callback function type
 typedef void (*event_callback)(const char *path, const char *filename);
 
+// Callback that also receives interned ids for the directory and filename
+typedef void (*event_id_callback)(const char *path, uint32_t path_id,
+                                  const char *filename, uint32_t name_id);
+
+// Callback that also receives the file's stable identity (see file_id.h)
+typedef void (*event_file_callback)(const char *path, const char *filename, uint64_t file_id);
+
 // Callback structure
 typedef struct {
     uint32_t mask;              // Event mask to trigger on
     char *pattern;              // Pattern to match
     event_callback callback;    // Function to call
+    event_id_callback id_callback;  // Or this one, with interned ids
+    event_file_callback file_callback;  // Or this one, with the file id
 } callback_info;
 
 // Global variables
@@ -50,9 +112,155 @@ static int recursive_mode = 0;                  // Watch directories recursively
 static watch_info watches[MAX_WATCHES];         // Watch descriptor mapping
 static int watch_count = 0;                     // Number of active watches
 static callback_info callbacks[MAX_CALLBACKS];  // Callback registry
+static uint32_t unscoped_callbacks = 0;         // Callbacks that see every directory
+static path_radix callback_routes;              // Directory prefix -> scoped callbacks
 static int callback_count = 0;                  // Number of registered callbacks
+static uint32_t id_callbacks = 0;               // Callbacks that want interned ids
+static char **callback_scopes = NULL;           // Subtrees the built-in callbacks are limited to
+static int callback_scope_count = 0;            // Number of scopes (0 = whole tree)
+static int executor_procs = 0;                  // Helper processes running callbacks (0 = inline)
 static char **patterns = NULL;                  // Filename patterns to match
 static int pattern_count = 0;                   // Number of patterns
+static char **excludes = NULL;                  // Filename patterns to ignore
+static int exclude_count = 0;                   // Number of excludes
+static char *pattern_store = NULL;              // Strings behind runtime patterns (NULL = argv)
+static char *exclude_store = NULL;              // Strings behind runtime excludes
+static pattern_matcher matcher;                 // Compiled patterns and excludes
+static int matcher_active = 0;                  // Any patterns or excludes compiled?
+static const char *pattern_cache_file = NULL;   // Precompiled pattern cache
+static int ignore_case = 0;                     // Case-insensitive pattern matching
+static uint32_t watch_mask = DEFAULT_WATCH_MASK; // Events requested from inotify
+static const char *integrity_file = NULL;       // Baseline file for integrity mode
+static int hash_threads = 0;                    // Startup hashing/indexing threads (0 = auto)
+static const char *index_file = NULL;           // Trigram index output file
+static time_t index_saved_at = 0;               // Last time the index was written
+static const char *merkle_file = NULL;          // Merkle tree snapshot file
+static time_t merkle_saved_at = 0;              // Last time the snapshot was written
+static double scrub_rate = 0;                   // Directories re-checked per second (0 = no scrubbing)
+static double scrub_tokens = 0;                 // Directory visits currently allowed
+static uint64_t scrub_refilled_at = 0;          // Last token refill (monotonic ms)
+static int scrub_cursor = 0;                    // Next watch to re-check
+static uint64_t scrub_passes = 0;               // Completed passes over all watches
+static int file_ids = 0;                        // Attach stable file ids to events
+static uint32_t dispatch_cookie = 0;            // Rename cookie of the event being processed
+static int usage_tracking = 0;                  // Keep per-directory disk usage current
+static const char *control_socket = NULL;       // Unix socket for runtime commands
+static double crawl_rate = 0;                   // Startup crawl directories per second (0 = unlimited)
+static int crawl_idle_io = 0;                   // Crawl in the idle I/O scheduling class
+static uint64_t settle_ms = 0;                  // Report files quiet this long after a change (0 = off)
+static backlog_level backlog_reported = BACKLOG_NORMAL; // Kernel queue pressure last reported
+static int git_aware = 0;                       // Batch worktree events during git operations
+static int queue_events = 0;                    // Decouple reading from processing via lanes
+static union {                                  // IN_MOVED_FROM waiting for its IN_MOVED_TO
+    struct inotify_event event;
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+} held_move;
+static int held_lane = -1;                      // Lane of held_move (-1 = none held)
+static size_t queue_memory = 0;                 // Memory budget for queued events (0 = unbounded)
+static const char *spill_dir = NULL;            // Where queued events overflow to
+static uint32_t spilled_reported = 0;           // Spill depth at the last report
+static int summary_interval = 0;                // Seconds per summary window (0 = per-event output)
+static time_t summary_window_end = 0;           // When the current window closes
+static double sample_fraction = 0;              // Fraction of paths processed (0 = all)
+static time_t sample_reported_at = 0;           // Last sampling statistics report
+static unsigned long long benchmark_events = 0; // Replay this many synthetic events and exit
+static unsigned long long benchmark_dispatched = 0; // Benchmark events that reached a callback
+
+/**
+ * Milliseconds on the monotonic clock
+ */
+uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/**
+ * Callbacks that apply to events in directory path
+ */
+uint32_t callbacks_for(const char *path) {
+    if (!callback_routes.prefixes) {
+        return unscoped_callbacks;
+    }
+    return unscoped_callbacks | path_radix_match(&callback_routes, path);
+}
+
+/**
+ * Event types that could reach any consumer for events in path, given
+ * the current callbacks, patterns and modes
+ */
+uint32_t compute_interest(const char *path) {
+    // Lock files under .git are tracked whatever the filters say
+    if (git_aware && git_is_internal(path)) {
+        return IN_ALL_EVENTS;
+    }
+    
+    // The tree hash and disk usage follow every file, matched or not.
+    // Sampling needs nothing of its own: it only counts what consumers want.
+    uint32_t interest = merkle_file || usage_tracking ? TREE_EVENTS : 0;
+    if (matcher_active && pattern_matches_nothing(&matcher)) {
+        return interest;
+    }
+    
+    if (!summary_interval && ((FSW_EVENT_CONSOLE && !daemon_mode) || (FSW_EVENT_SYSLOG && daemon_mode))) {
+        interest |= OUTPUT_EVENTS;  // Per-event console/syslog lines
+    }
+    if (summary_interval) {
+        interest |= OUTPUT_EVENTS | IN_ATTRIB;
+    }
+    if (recursive_mode) {
+        interest |= IN_CREATE;  // New subdirectories
+    }
+    if (integrity_file || index_file) {
+        interest |= IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    }
+    if (settle_ms) {
+        interest |= SETTLE_EVENTS | IN_DELETE | IN_MOVED_FROM;
+    }
+    if (file_ids) {
+        interest |= IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;  // Cache upkeep
+    }
+    for (uint32_t set = callbacks_for(path); set; set &= set - 1) {
+        interest |= callbacks[__builtin_ctz(set)].mask;
+    }
+    return interest;
+}
+
+/**
+ * Events to ask the kernel for on a watch with the given interest. A
+ * watch always asks for something, or inotify_add_watch would refuse it.
+ */
+uint32_t kernel_mask(uint32_t interest) {
+    uint32_t mask = watch_mask & interest;
+    return mask ? mask : IN_DELETE_SELF;
+}
+
+/**
+ * Recompute every watch's interest after a configuration change, and
+ * narrow or widen what the kernel delivers for it to match
+ */
+void refresh_interest() {
+    for (int i = 0; i < watch_count; i++) {
+        uint32_t was = kernel_mask(watches[i].interest);
+        watches[i].interest = compute_interest(watches[i].path);
+        if (kernel_mask(watches[i].interest) == was) {
+            continue;
+        }
+        
+        // Re-arm the watch with the new mask. If the path no longer leads to
+        // the watched directory this creates a watch nobody tracks; drop it.
+        int wd = inotify_add_watch(fd, watches[i].path, kernel_mask(watches[i].interest));
+        if (wd >= 0 && wd != watches[i].wd) {
+            int tracked = 0;
+            for (int j = 0; j < watch_count && !tracked; j++) {
+                tracked = watches[j].wd == wd;
+            }
+            if (!tracked) {
+                inotify_rm_watch(fd, wd);
+            }
+        }
+    }
+}
 
 /**
  * Register a callback function for specific events
@@ -65,8 +273,86 @@ int register_callback(uint32_t event_mask, const char *pattern, event_callback c
     callbacks[callback_count].mask = event_mask;
     callbacks[callback_count].pattern = pattern ? strdup(pattern) : NULL;
     callbacks[callback_count].callback = cb;
+    callbacks[callback_count].id_callback = NULL;
+    callbacks[callback_count].file_callback = NULL;
+    unscoped_callbacks |= 1u << callback_count;
+    callback_count++;
+    
+    refresh_interest();
+    return callback_count - 1;
+}
+
+/**
+ * Limit a registered callback to prefix and the directories below it; a
+ * callback given several prefixes sees events under any of them. Events
+ * are routed through a radix tree of prefixes, so other subtrees never
+ * reach it, and watches outside every prefix drop the event types only it
+ * wanted from their kernel mask.
+ */
+int add_callback_scope(int slot, const char *prefix) {
+    if (path_radix_insert(&callback_routes, prefix, 1u << slot) < 0) {
+        return -1;
+    }
+    unscoped_callbacks &= ~(1u << slot);
+    refresh_interest();
+    return 0;
+}
+
+/**
+ * Register a callback that only sees events in prefix and below
+ */
+int register_prefix_callback(const char *prefix, uint32_t event_mask, const char *pattern,
+                             event_callback cb) {
+    int slot = register_callback(event_mask, pattern, cb);
+    if (slot < 0) {
+        return -1;
+    }
+    
+    if (add_callback_scope(slot, prefix) < 0) {
+        free(callbacks[slot].pattern);
+        unscoped_callbacks &= ~(1u << slot);
+        callback_count--;
+        refresh_interest();
+        return -1;
+    }
+    return slot;
+}
+
+/**
+ * Register a callback that is handed stable ids for the directory and
+ * filename (see intern.h), so it can key caches on integers
+ */
+int register_id_callback(uint32_t event_mask, const char *pattern, event_id_callback cb) {
+    int slot = register_callback(event_mask, pattern, NULL);
+    if (slot >= 0) {
+        callbacks[slot].id_callback = cb;
+        id_callbacks |= 1u << slot;
+    }
+    return slot;
+}
+
+/**
+ * Register a callback that is handed the file's stable id, which follows
+ * the file across renames (see file_id.h). Must be called before startup.
+ */
+int register_file_callback(uint32_t event_mask, const char *pattern, event_file_callback cb) {
+    int slot = register_callback(event_mask, pattern, NULL);
+    if (slot >= 0) {
+        callbacks[slot].file_callback = cb;
+        file_ids = 1;
+    }
+    return slot;
+}
+
+/**
+ * Check if a file matches any of the patterns
+ */
+int matches_pattern(const char *filename) {
+    if (!matcher_active) {
+        return 1;  // No patterns means match everything
+    }
     
-    return callback_count++;
+    return pattern_match(&matcher, filename);
 }
 
 /**
@@ -83,10 +369,9 @@ int add_watch(const char *path) {
         return -1;
     }
     
-    // Add the watch
-    int wd = inotify_add_watch(fd, path, 
-                  IN_CREATE | IN_MODIFY | IN_DELETE | 
-                  IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB);
+    // Add the watch, asking only for events something here will act on
+    uint32_t interest = compute_interest(path);
+    int wd = inotify_add_watch(fd, path, kernel_mask(interest));
     
     if (wd < 0) {
         if (daemon_mode) {
@@ -101,6 +386,7 @@ int add_watch(const char *path) {
     watches[watch_count].wd = wd;
     strncpy(watches[watch_count].path, path, PATH_MAX - 1);
     watches[watch_count].path[PATH_MAX - 1] = '\0';
+    watches[watch_count].interest = interest;
     
     if (daemon_mode) {
         syslog(LOG_INFO, "Watching directory: %s (wd=%d)", path, wd);
@@ -109,106 +395,1268 @@ int add_watch(const char *path) {
     }
     
     watch_count++;
+    
+    // Files already here get their ids now, so renaming or deleting one
+    // that no event has mentioned yet still reports who it was
+    if (file_ids && !(git_aware && git_is_internal(path))) {
+        file_id_seed_dir(path, matches_pattern);
+    }
+    
+    // The scrubber's first visit compares against this listing, so drift
+    // between now and then is caught too
+    if (scrub_rate) {
+        scrub_seed(path, wd);
+    }
     return wd;
 }
 
 /**
- * Look up the path for a given watch descriptor
+ * Look up the watch entry for a given watch descriptor
  */
-const char* get_path_by_wd(int wd) {
+const watch_info *get_watch_by_wd(int wd) {
     for (int i = 0; i < watch_count; i++) {
         if (watches[i].wd == wd) {
-            return watches[i].path;
+            return &watches[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Look up the path for a given watch descriptor
+ */
+const char* get_path_by_wd(int wd) {
+    const watch_info *w = get_watch_by_wd(wd);
+    return w ? w->path : NULL;
+}
+
+/**
+ * Recursively add watches for a directory and all its subdirectories
+ */
+static int ftw_callback(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    if (typeflag == FTW_D && ftwbuf->level >= 0) {  // Directory and not the root (which is already watched)
+        crawl_throttle();
+        add_watch(path);
+        
+        // Only the .git directory itself is needed to see lock files come and go
+        if (git_aware && strcmp(path + ftwbuf->base, ".git") == 0) {
+            return FTW_SKIP_SUBTREE;
+        }
+    }
+    return FTW_CONTINUE;
+}
+
+void watch_recursively(const char *path) {
+    if (nftw(path, ftw_callback, 16, FTW_PHYS | FTW_ACTIONRETVAL) == -1) {
+        if (daemon_mode) {
+            syslog(LOG_ERR, "Failed to recursively watch %s: %s", path, strerror(errno));
+        } else {
+            fprintf(stderr, "Failed to recursively watch %s: %s\n", path, strerror(errno));
+        }
+    }
+}
+
+/**
+ * Compile patterns and excludes, or map them from the cache if it is current
+ */
+int load_patterns() {
+    if (pattern_count == 0 && exclude_count == 0) {
+        return 0;
+    }
+    
+    int flags = ignore_case ? PATTERN_ICASE : 0;
+    uint64_t config_hash = pattern_config_hash(patterns, pattern_count, excludes, exclude_count, flags);
+    if (pattern_cache_file && pattern_cache_load(&matcher, pattern_cache_file, config_hash) == 0) {
+        matcher_active = 1;
+        return 0;
+    }
+    
+    if (pattern_compile(&matcher, patterns, pattern_count, excludes, exclude_count, flags) < 0) {
+        return -1;
+    }
+    matcher_active = 1;
+    
+    if (pattern_cache_file && pattern_cache_save(&matcher, pattern_cache_file) < 0) {
+        fprintf(stderr, "Warning: failed to write pattern cache %s: %s\n",
+                pattern_cache_file, strerror(errno));
+    }
+    return 0;
+}
+
+/**
+ * Compare a changed file against the integrity baseline and report drift
+ */
+void check_integrity(uint32_t event_mask, const char *path, const char *filename) {
+    if (event_mask & IN_ISDIR) {
+        return;
+    }
+    
+    // Content is only final once the writer closes the file
+    int removed = (event_mask & (IN_DELETE | IN_MOVED_FROM)) != 0;
+    if (!removed && !(event_mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+        return;
+    }
+    
+    char full_path[PATH_MAX];
+    snprintf(full_path, PATH_MAX, "%s/%s", path, filename);
+    
+    integrity_status status = integrity_check(full_path, removed);
+    if (status == INTEGRITY_UNCHANGED) {
+        return;
+    }
+    
+    if (daemon_mode) {
+        syslog(LOG_WARNING, "Integrity: %s %s", full_path, integrity_status_name(status));
+    } else {
+        printf("INTEGRITY: %s %s\n", full_path, integrity_status_name(status));
+    }
+}
+
+/**
+ * Keep the trigram index in step with the watched tree
+ */
+void update_index(uint32_t event_mask, const char *path, const char *filename) {
+    char full_path[PATH_MAX];
+    snprintf(full_path, PATH_MAX, "%s/%s", path, filename);
+    
+    if (event_mask & IN_ISDIR) {
+        if (event_mask & (IN_DELETE | IN_MOVED_FROM)) {
+            trigram_index_remove_tree(full_path);
+        } else if (event_mask & IN_MOVED_TO) {
+            trigram_index_add_tree(full_path);
+        }
+        return;
+    }
+    
+    if (event_mask & (IN_DELETE | IN_MOVED_FROM)) {
+        trigram_index_remove(full_path);
+    } else if (event_mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        trigram_index_update(full_path);
+    }
+}
+
+/**
+ * Save the trigram index if it changed and the save interval has passed
+ */
+void save_index(int force) {
+    if (!trigram_index_dirty()) {
+        return;
+    }
+    
+    time_t now = time(NULL);
+    if (!force && now - index_saved_at < INDEX_SAVE_INTERVAL) {
+        return;
+    }
+    index_saved_at = now;
+    
+    if (trigram_index_save(index_file) < 0) {
+        if (daemon_mode) {
+            syslog(LOG_ERR, "Failed to save index %s: %s", index_file, strerror(errno));
+        } else {
+            fprintf(stderr, "Failed to save index %s: %s\n", index_file, strerror(errno));
+        }
+    }
+}
+
+/**
+ * Write the Merkle tree snapshot if it changed and the save interval has passed
+ */
+void save_merkle(int force) {
+    if (!merkle_dirty()) {
+        return;
+    }
+    
+    time_t now = time(NULL);
+    if (!force && now - merkle_saved_at < INDEX_SAVE_INTERVAL) {
+        return;
+    }
+    merkle_saved_at = now;
+    
+    if (merkle_save(merkle_file) < 0) {
+        if (daemon_mode) {
+            syslog(LOG_ERR, "Failed to save Merkle tree %s: %s", merkle_file, strerror(errno));
+        } else {
+            fprintf(stderr, "Failed to save Merkle tree %s: %s\n", merkle_file, strerror(errno));
+        }
+    }
+}
+
+/**
+ * Announce a consolidated batch of events from a finished git operation
+ */
+void report_git_batch(const char *repo, uint32_t raw_events, uint32_t batched_events) {
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Git operation finished in %s: %u events consolidated into %u",
+               repo, raw_events, batched_events);
+    } else {
+        printf("Git operation finished in %s: %u events consolidated into %u\n",
+               repo, raw_events, batched_events);
+    }
+}
+
+/**
+ * Report a file that has seen no further changes for settle_ms
+ */
+void report_settled(const char *full_path, void *arg) {
+    (void)arg;
+    if (daemon_mode) {
+        syslog(LOG_INFO, "File settled: %s", full_path);
+    } else {
+        printf("File settled: %s\n", full_path);
+    }
+}
+
+/**
+ * Restart a file's quiet-period timer on every change, and forget it
+ * once the file is gone
+ */
+void track_settle(uint32_t event_mask, const char *path, const char *filename) {
+    char full_path[PATH_MAX];
+    if ((event_mask & IN_ISDIR) ||
+        snprintf(full_path, PATH_MAX, "%s/%s", path, filename) >= PATH_MAX) {
+        return;
+    }
+    
+    if (event_mask & (IN_DELETE | IN_MOVED_FROM)) {
+        timer_cancel(full_path);
+    } else if (event_mask & SETTLE_EVENTS) {
+        timer_schedule(full_path, settle_ms, report_settled, NULL);
+    }
+}
+
+/**
+ * Run the matched callbacks for an event, inline or in an executor
+ */
+void run_callbacks(const executor_event *ev) {
+    for (uint32_t set = ev->callbacks; set; set &= set - 1) {
+        int i = __builtin_ctz(set);
+        if (callbacks[i].file_callback) {
+            callbacks[i].file_callback(ev->path, ev->name, ev->file_id);
+        } else if (callbacks[i].id_callback) {
+            callbacks[i].id_callback(ev->path, ev->path_id, ev->name, ev->name_id);
+        } else {
+            callbacks[i].callback(ev->path, ev->name);
+        }
+    }
+}
+
+/**
+ * Log, print and run callbacks for an event that made it through filtering
+ */
+void dispatch_event(uint32_t event_mask, const char *path, const char *filename) {
+    // Resolve the file's identity once for output and callbacks
+    uint64_t file_id = FILE_ID_NONE;
+    char id_note[32] = "";
+    if (file_ids) {
+        char full_path[PATH_MAX];
+        if (snprintf(full_path, PATH_MAX, "%s/%s", path, filename) < PATH_MAX) {
+            file_id = file_id_for_event(full_path, event_mask, dispatch_cookie);
+        }
+        snprintf(id_note, sizeof(id_note), " [id %016llx]", (unsigned long long)file_id);
+    }
+    
+#if FSW_EVENT_SYSLOG
+    // Log the event if in daemon mode
+    if (daemon_mode && !summary_interval) {
+        if (event_mask & IN_CREATE)
+            syslog(LOG_INFO, "File created: %s/%s%s", path, filename, id_note);
+        if (event_mask & IN_DELETE)
+            syslog(LOG_INFO, "File deleted: %s/%s%s", path, filename, id_note);
+        if (event_mask & IN_MODIFY)
+            syslog(LOG_INFO, "File modified: %s/%s%s", path, filename, id_note);
+        if (event_mask & IN_MOVED_FROM)
+            syslog(LOG_INFO, "File moved from: %s/%s%s", path, filename, id_note);
+        if (event_mask & IN_MOVED_TO)
+            syslog(LOG_INFO, "File moved to: %s/%s%s", path, filename, id_note);
+    }
+#endif
+    
+    // Report content changes versus the baseline
+    if (integrity_file) {
+        check_integrity(event_mask, path, filename);
+    }
+    
+    // Keep the content index current
+    if (index_file) {
+        update_index(event_mask, path, filename);
+    }
+    
+    // Restart the file's quiet period
+    if (settle_ms) {
+        track_settle(event_mask, path, filename);
+    }
+    
+    // Pick the callbacks for this subtree whose mask and pattern match
+    uint32_t matched = 0;
+    for (uint32_t set = callbacks_for(path); set; set &= set - 1) {
+        int i = __builtin_ctz(set);
+        if ((callbacks[i].mask & event_mask) &&
+            (!callbacks[i].pattern ||
+             fnmatch(callbacks[i].pattern, filename, ignore_case ? FNM_CASEFOLD : 0) == 0)) {
+            matched |= 1u << i;
+        }
+    }
+    
+    if (matched) {
+        executor_event ev;
+        ev.mask = event_mask;
+        ev.callbacks = matched;
+        ev.path = path;
+        ev.name = filename;
+        ev.file_id = file_id;
+        
+        // Intern once per event, and only if someone wants the ids
+        ev.path_id = ev.name_id = INTERN_NONE;
+        if (matched & id_callbacks) {
+            ev.path_id = intern(path);
+            ev.name_id = intern(filename);
+        }
+        
+        if (executor_count()) {
+            executor_submit(&ev);
+        } else {
+            run_callbacks(&ev);
+        }
+    }
+    
+#if FSW_EVENT_CONSOLE
+    // Also print the raw event info if not in daemon mode
+    if (!daemon_mode && !summary_interval) {
+        if (event_mask & IN_CREATE)
+            printf("File created: %s/%s%s\n", path, filename, id_note);
+        if (event_mask & IN_DELETE)
+            printf("File deleted: %s/%s%s\n", path, filename, id_note);
+        if (event_mask & IN_MODIFY)
+            printf("File modified: %s/%s%s\n", path, filename, id_note);
+        if (event_mask & IN_MOVED_FROM)
+            printf("File moved from: %s/%s%s\n", path, filename, id_note);
+        if (event_mask & IN_MOVED_TO)
+            printf("File moved to: %s/%s%s\n", path, filename, id_note);
+    }
+#endif
+}
+
+/**
+ * Add a watch for a directory created under a watched one (recursive mode)
+ */
+void watch_new_directory(uint32_t event_mask, const char *path, const char *filename) {
+    if (recursive_mode && (event_mask & IN_CREATE) && (event_mask & IN_ISDIR)) {
+        char full_path[PATH_MAX];
+        snprintf(full_path, PATH_MAX, "%s/%s", path, filename);
+        add_watch(full_path);
+        
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Added watch for new directory: %s", full_path);
+        } else {
+            printf("Added watch for new directory: %s\n", full_path);
         }
     }
+}
+
+/**
+ * Process an event and trigger appropriate callbacks
+ */
+void process_event(uint32_t event_mask, const char *path, const char *filename) {
+    // Check if this is a new directory and we're in recursive mode
+    watch_new_directory(event_mask, path, filename);
+    
+    // Hold worktree events while a git operation is running
+    if (git_aware) {
+        if (strcmp(filename, ".git") == 0 || git_guard_hold(path, filename, event_mask, dispatch_cookie)) {
+            return;
+        }
+    }
+    
+    dispatch_event(event_mask, path, filename);
+}
+
+/**
+ * Deliver an event held during a git operation with the rename cookie it
+ * arrived with, so file ids and rename pairing survive the hold
+ */
+void deliver_git_event(uint32_t event_mask, uint32_t cookie, const char *path, const char *filename) {
+    dispatch_cookie = cookie;
+    dispatch_event(event_mask, path, filename);
+    dispatch_cookie = 0;
+}
+
+/**
+ * Handle one raw inotify event
+ */
+void handle_event(const struct inotify_event *event) {
+    if (!event->len) {
+        return;
+    }
+    
+    // Get the watch entry; drop the event if nothing could act on it
+    const watch_info *w = get_watch_by_wd(event->wd);
+    if (w && !(event->mask & w->interest)) {
+        return;
+    }
+    
+    const char *path = w ? w->path : NULL;
+    if (path) {
+        // The tree hash covers every file, whatever the filters below say
+        if (merkle_file && !(git_aware && git_is_internal(path))) {
+            char full_path[PATH_MAX];
+            if (snprintf(full_path, PATH_MAX, "%s/%s", path, event->name) < PATH_MAX) {
+                merkle_update(full_path);
+            }
+        }
+        
+        // So does disk usage, .git included
+        if (usage_tracking) {
+            char full_path[PATH_MAX];
+            if (snprintf(full_path, PATH_MAX, "%s/%s", path, event->name) < PATH_MAX) {
+                usage_update(full_path);
+            }
+        }
+        
+        if (git_aware && git_is_internal(path)) {
+            // Track lock files only; .git internals never reach the pipeline
+            git_guard_internal_event(path, event->name, event->mask, now_ms());
+        } else if (sample_fraction && !sampling_keep(path, event->name)) {
+            // Outside the sample, but the tree must still be followed
+            watch_new_directory(event->mask, path, event->name);
+        } else if (matches_pattern(event->name)) {
+            // Count it for the summary window
+            if (summary_interval) {
+                summary_record(event->wd, event->mask);
+            }
+            
+            // Process the event
+            dispatch_cookie = event->cookie;
+            process_event(event->mask, path, event->name);
+            dispatch_cookie = 0;
+        }
+    } else {
+        if (daemon_mode) {
+            syslog(LOG_WARNING, "Received event for unknown watch descriptor: %d", event->wd);
+        } else {
+            fprintf(stderr, "Warning: Received event for unknown watch descriptor: %d\n", event->wd);
+        }
+    }
+}
+
+/**
+ * Queue an event on a lane, or process it inline if it can't be queued
+ */
+void push_event(int lane, const struct inotify_event *event) {
+    if (lanes_push(lane, event) < 0) {
+        // Out of memory: process inline rather than drop it
+        handle_event(event);
+    }
+}
+
+/**
+ * Queue an IN_MOVED_FROM still waiting for its IN_MOVED_TO
+ */
+void queue_held_move() {
+    if (held_lane >= 0) {
+        int lane = held_lane;
+        held_lane = -1;
+        push_event(lane, &held_move.event);
+    }
+}
+
+/**
+ * Queue an event on the lane for its priority class
+ */
+void queue_event(const struct inotify_event *event) {
+    const watch_info *w = event->len ? get_watch_by_wd(event->wd) : NULL;
+    if (!w) {
+        queue_held_move();
+        handle_event(event);  // Nothing to classify or queue
+        return;
+    }
+    if (!(event->mask & w->interest)) {
+        return;  // Don't spend queue memory on it
+    }
+    
+    // Each half of a rename is classified by its own directory; the pair
+    // goes to the more urgent of the two lanes so the source is never
+    // handled after the target
+    int lane = lanes_classify(w->path, event->name);
+    if (held_lane >= 0) {
+        if ((event->mask & IN_MOVED_TO) && event->cookie == held_move.event.cookie) {
+            if (held_lane < lane) {
+                lane = held_lane;
+            }
+            held_lane = lane;
+        }
+        queue_held_move();
+    }
+    if ((event->mask & IN_MOVED_FROM) && event->cookie) {
+        memcpy(held_move.buf, event, sizeof(*event) + event->len);
+        held_lane = lane;
+        return;
+    }
+    push_event(lane, event);
+}
+
+/**
+ * Run a decoded buffer through the pipeline: filter on the wd/mask
+ * columns first, then hand only the surviving records on
+ */
+void process_batch(const event_batch *batch, const char *buffer, backlog_level level) {
+    static uint16_t keep[EVENT_BATCH_MAX];
+    uint32_t kept = 0;
+    int last_wd = -1;
+    const watch_info *last_w = NULL;
+    uint32_t interest = IN_ALL_EVENTS;
+    
+    // Events from one directory tend to arrive together; look each run up once
+    for (uint32_t i = 0; i < batch->count; i++) {
+        if (batch->mask[i] & IN_Q_OVERFLOW) {
+            backlog_note_overflow();
+        }
+        if (batch->wd[i] != last_wd) {
+            last_w = get_watch_by_wd(batch->wd[i]);
+            last_wd = batch->wd[i];
+            interest = last_w ? last_w->interest : IN_ALL_EVENTS;  // Unknown wds get reported downstream
+        }
+        if (batch->name_len[i] && (batch->mask[i] & interest)) {
+            keep[kept++] = (uint16_t)i;
+        }
+        
+        // Any event explains a difference the scrubber may have staged
+        if (scrub_rate && batch->name_len[i] && last_w) {
+            scrub_touch(last_w->path, buffer + batch->name[i]);
+        }
+    }
+    
+    backlog_batch_begin();
+    for (uint32_t k = 0; k < kept; k++) {
+        const struct inotify_event *event =
+            (const struct inotify_event *)(buffer + batch->record[keep[k]]);
+        
+        if (level >= BACKLOG_HIGH && backlog_coalesce(event)) {
+            continue;  // A repeat of a modify/attrib already in this buffer
+        }
+        if (queue_events) {
+            queue_event(event);
+        } else {
+            handle_event(event);
+        }
+    }
+}
+
+/**
+ * Replay a change the scrubber found that no event reported, so every
+ * consumer converges on what is actually on disk
+ */
+int scrub_correct(int wd, const char *dir, const char *name, uint32_t mask, void *arg) {
+    (void)arg;
+    const watch_info *w = get_watch_by_wd(wd);
+    if (!w || strcmp(w->path, dir) != 0 || !(mask & w->interest)) {
+        return 0;  // Watch gone (or wd reused), or nothing would act on it
+    }
+    
+    // Subdirectories from a first visit only matter if they are not watched
+    if ((mask & IN_CREATE) && (mask & IN_ISDIR)) {
+        char full_path[PATH_MAX];
+        if (!recursive_mode || snprintf(full_path, PATH_MAX, "%s/%s", dir, name) >= PATH_MAX) {
+            return 0;
+        }
+        for (int i = 0; i < watch_count; i++) {
+            if (strcmp(watches[i].path, full_path) == 0) {
+                return 0;
+            }
+        }
+    }
+    
+    uint64_t storage[(sizeof(struct inotify_event) + NAME_MAX + 1) / sizeof(uint64_t) + 1];
+    struct inotify_event *event = (struct inotify_event *)storage;
+    size_t len = strlen(name);
+    if (len > NAME_MAX) {
+        return 0;
+    }
+    event->wd = wd;
+    event->mask = mask;
+    event->cookie = 0;
+    event->len = (uint32_t)len + 1;
+    memcpy(event->name, name, len + 1);
+    
+    const char *what = (mask & IN_DELETE) ? "delete" : (mask & IN_MODIFY) ? "modify" : "create";
+    if (daemon_mode) {
+        syslog(LOG_WARNING, "Scrub: replaying missed %s of %s/%s", what, dir, name);
+    } else {
+        printf("Scrub: replaying missed %s of %s/%s\n", what, dir, name);
+    }
+    handle_event(event);
+    return 1;
+}
+
+/**
+ * Re-check a budgeted number of directories against what events told us.
+ * Only runs while fully caught up, so anything still unexplained when the
+ * next run confirms really was missed.
+ */
+void run_scrub() {
+    backlog_stats st;
+    backlog_get_stats(&st);
+    if (st.bytes || lanes_pending()) {
+        return;
+    }
+    
+    uint64_t now = now_ms();
+    scrub_tokens += (double)(now - scrub_refilled_at) * scrub_rate / 1000.0;
+    scrub_refilled_at = now;
+    if (scrub_tokens > (scrub_rate > 1 ? scrub_rate : 1)) {
+        scrub_tokens = scrub_rate > 1 ? scrub_rate : 1;  // No bursts after a busy spell
+    }
+    
+    scrub_confirm(scrub_correct, NULL);
+    
+    while (scrub_tokens >= 1 && watch_count > 0 && now_ms() - now < SCRUB_SLICE_MS) {
+        if (scrub_cursor >= watch_count) {
+            scrub_cursor = 0;
+            scrub_passes++;
+        }
+        scrub_visit(watches[scrub_cursor].path, watches[scrub_cursor].wd);
+        scrub_cursor++;
+        scrub_tokens -= 1;
+    }
+}
+
+/**
+ * Report a change in how far behind the kernel queue we are
+ */
+void report_backlog(backlog_level level) {
+    static const char *actions[] = {
+        "back to normal",
+        "coalescing repeated events",
+        "coalescing and reading ahead of handling"
+    };
+    backlog_stats st;
+    backlog_get_stats(&st);
+    backlog_reported = level;
+    
+    if (daemon_mode) {
+        syslog(level > BACKLOG_NORMAL ? LOG_WARNING : LOG_INFO,
+               "Event backlog %s: ~%u events in the kernel queue (%.0f%% of max_queued_events %u), %s",
+               backlog_level_name(level), st.events, st.fill * 100, st.max_queued, actions[level]);
+    } else {
+        fprintf(stderr, "Event backlog %s: ~%u events in the kernel queue (%.0f%% of max_queued_events %u), %s\n",
+                backlog_level_name(level), st.events, st.fill * 100, st.max_queued, actions[level]);
+    }
+}
+
+/**
+ * Report when the event queue starts or stops spilling to disk
+ */
+void report_spill() {
+    uint32_t spilled = lanes_spilled();
+    if ((spilled == 0) == (spilled_reported == 0)) {
+        return;
+    }
+    
+    if (daemon_mode) {
+        if (spilled) {
+            syslog(LOG_WARNING, "Event queue over %zu bytes, spilling to %s", queue_memory, spill_dir);
+        } else {
+            syslog(LOG_INFO, "Event queue spill drained");
+        }
+    } else {
+        if (spilled) {
+            fprintf(stderr, "Warning: event queue over %zu bytes, spilling to %s\n", queue_memory, spill_dir);
+        } else {
+            fprintf(stderr, "Event queue spill drained\n");
+        }
+    }
+    spilled_reported = spilled;
+}
+
+/**
+ * Print one directory's counts for the window that just closed
+ */
+void emit_summary_line(int wd, const uint32_t counts[SUMMARY_TYPES]) {
+    const char *path = wd == SUMMARY_OTHER_WD ? "(other)" : get_path_by_wd(wd);
+    char line[PATH_MAX + 256];
+    int len = snprintf(line, sizeof(line), "%s", path ? path : "(removed)");
+    
+    for (int t = 0; t < SUMMARY_TYPES && len < (int)sizeof(line); t++) {
+        len += snprintf(line + len, sizeof(line) - len, " %s=%u", summary_type_name(t), counts[t]);
+    }
+    
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Summary: %s", line);
+    } else {
+        printf("SUMMARY: %s\n", line);
+    }
+}
+
+/**
+ * Close the summary window once its interval has passed
+ */
+void emit_summary() {
+    time_t now = time(NULL);
+    if (now < summary_window_end) {
+        return;
+    }
+    
+    uint64_t total = summary_emit(emit_summary_line);
+    if (sample_fraction) {
+        // Counts above only cover sampled paths
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Summary: %llu sampled events in %ds window (estimated total %llu)",
+                   (unsigned long long)total, summary_interval,
+                   (unsigned long long)sampling_estimate(total));
+        } else {
+            printf("SUMMARY: %llu sampled events in %ds window (estimated total %llu)\n",
+                   (unsigned long long)total, summary_interval,
+                   (unsigned long long)sampling_estimate(total));
+        }
+    } else if (daemon_mode) {
+        syslog(LOG_INFO, "Summary: %llu events in %ds window", (unsigned long long)total, summary_interval);
+    } else {
+        printf("SUMMARY: %llu events in %ds window\n", (unsigned long long)total, summary_interval);
+    }
+    fflush(stdout);
+    
+    // Windows line up with wall-clock multiples of the interval
+    summary_window_end = (now / summary_interval + 1) * summary_interval;
+}
+
+/**
+ * Report how many events the sample kept and the extrapolated total
+ */
+void report_sampling(int force) {
+    time_t now = time(NULL);
+    if (!force && now - sample_reported_at < SAMPLE_REPORT_INTERVAL) {
+        return;
+    }
+    sample_reported_at = now;
+    
+    uint64_t seen, kept;
+    sampling_stats(&seen, &kept);
+    sampling_reset();
+    
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Sampling: kept %llu of %llu events (fraction %g, estimated total %llu)",
+               (unsigned long long)kept, (unsigned long long)seen, sample_fraction,
+               (unsigned long long)sampling_estimate(kept));
+    } else {
+        printf("SAMPLING: kept %llu of %llu events (fraction %g, estimated total %llu)\n",
+               (unsigned long long)kept, (unsigned long long)seen, sample_fraction,
+               (unsigned long long)sampling_estimate(kept));
+    }
+}
+
+/**
+ * In a new executor: let go of the daemon's inotify descriptor and control
+ * socket, so nothing a callback does can touch the daemon's watches
+ */
+void detach_executor() {
+    close(fd);
+    fd = -1;
+    control_forget();
+}
+
+/**
+ * Report a callback executor that died; executor_reap() restarts it
+ */
+void report_executor_exit(int index, int pid, int status, int skipped) {
+    char how[32];
+    if (WIFSIGNALED(status)) {
+        snprintf(how, sizeof(how), "signal %d", WTERMSIG(status));
+    } else {
+        snprintf(how, sizeof(how), "status %d", WEXITSTATUS(status));
+    }
+    
+    if (daemon_mode) {
+        syslog(LOG_WARNING, "Executor %d (pid %d) died with %s%s, restarting", index, pid, how,
+               skipped ? "; skipping the event it was running" : "");
+    } else {
+        fprintf(stderr, "Executor %d (pid %d) died with %s%s, restarting\n", index, pid, how,
+                skipped ? "; skipping the event it was running" : "");
+    }
+}
+
+/**
+ * How long poll may sleep: one tick, or less if a timer is due sooner
+ */
+int poll_timeout() {
+    uint64_t next = timer_next_ms(now_ms());
+    return next < TICK_MS ? (int)next : TICK_MS;
+}
+
+/**
+ * Run work that is due regardless of incoming events
+ */
+void run_periodic_tasks() {
+    if (timer_pending()) {
+        timer_advance(now_ms());
+    }
+    
+    if (queue_memory) {
+        report_spill();
+    }
+    
+    if (summary_interval) {
+        emit_summary();
+    }
+    
+    if (sample_fraction) {
+        report_sampling(0);
+    }
+    
+    if (index_file) {
+        save_index(0);
+    }
+    
+    if (merkle_file) {
+        save_merkle(0);
+    }
+    
+    if (git_aware) {
+        git_guard_flush(now_ms(), 0, report_git_batch, deliver_git_event);
+    }
+    
+    if (executor_procs) {
+        executor_reap(report_executor_exit);
+    }
+}
+
+/**
+ * Benchmark consumer: keeps the dispatch path live in every build, so a
+ * lean build is measured without its output, not without its work
+ */
+void count_benchmark_event(const char *path, const char *filename) {
+    (void)path;
+    (void)filename;
+    benchmark_dispatched++;
+}
+
+/**
+ * Replay a synthetic workload through the event pipeline and report throughput
+ */
+void run_benchmark() {
+    int *wds = malloc((watch_count ? watch_count : 1) * sizeof(*wds));
+    if (!wds) {
+        fprintf(stderr, "Failed to allocate benchmark workload\n");
+        return;
+    }
+    for (int i = 0; i < watch_count; i++) {
+        wds[i] = watches[i].wd;
+    }
+    
+    // Generate the workload up front so only event handling is timed
+    static char buffers[BENCH_BUFFERS][BUF_LEN];
+    size_t lengths[BENCH_BUFFERS];
+    uint64_t seq = 1;
+    for (int b = 0; b < BENCH_BUFFERS; b++) {
+        lengths[b] = bench_fill_buffer(buffers[b], BUF_LEN, wds, watch_count, &seq);
+    }
+    free(wds);
+    
+    struct timespec start, end;
+    unsigned long long processed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    static event_batch batch;
+    for (int b = 0; processed < benchmark_events; b = (b + 1) % BENCH_BUFFERS) {
+        size_t i = 0;
+        
+        run_periodic_tasks();
+        if (lanes_pending()) {
+            lanes_drain(LANE_BATCH, handle_event);
+        }
+        
+        while (i < lengths[b] && processed < benchmark_events) {
+            size_t used = event_batch_decode(&batch, buffers[b] + i, lengths[b] - i);
+            if (batch.count > benchmark_events - processed) {
+                batch.count = (uint32_t)(benchmark_events - processed);
+            }
+            process_batch(&batch, buffers[b] + i, BACKLOG_NORMAL);
+            processed += batch.count;
+            i += used;
+        }
+        queue_held_move();
+    }
+    while (lanes_pending()) {
+        lanes_drain(LANE_BATCH, handle_event);
+    }
+    executor_flush();
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fflush(stdout);
+    
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Benchmark: %llu events in %.3f s, %llu dispatched (%.0f events/s)\n",
+            processed, seconds, benchmark_dispatched, seconds > 0 ? processed / seconds : 0.0);
+    if (executor_count()) {
+        executor_report(stderr);
+    }
+}
+
+/**
+ * Remove the watches on root and every directory below it
+ */
+int remove_watch_tree(const char *root) {
+    size_t len = strlen(root);
+    int removed = 0;
+    
+    for (int i = watch_count - 1; i >= 0; i--) {
+        const char *path = watches[i].path;
+        if (strncmp(path, root, len) == 0 && (path[len] == '\0' || path[len] == '/')) {
+            inotify_rm_watch(fd, watches[i].wd);
+            watches[i] = watches[--watch_count];
+            removed++;
+        }
+    }
+    if (removed && scrub_rate) {
+        scrub_forget_tree(root);
+    }
+    if (removed && file_ids) {
+        file_id_forget_tree(root);
+    }
+    return removed;
+}
+
+/**
+ * Replace a pattern list with the blank-separated globs in args
+ */
+int replace_pattern_list(char ***list, int *count, char **store, const char *args) {
+    char *copy = strdup(args);
+    char **items = malloc((strlen(args) / 2 + 1) * sizeof(*items));
+    if (!copy || !items) {
+        free(copy);
+        free(items);
+        return -1;
+    }
+    
+    int n = 0;
+    for (char *tok = strtok(copy, " \t"); tok; tok = strtok(NULL, " \t")) {
+        items[n++] = tok;
+    }
+    
+    // Startup patterns point into argv; only runtime lists are ours to free
+    if (*store || list == &excludes) {
+        free(*list);
+    }
+    free(*store);
+    *list = items;
+    *count = n;
+    *store = copy;
+    return 0;
+}
+
+/**
+ * LIST: one "wd path" line per watch
+ */
+const char *control_list(const char *command, char *args, FILE *out) {
+    (void)command;
+    (void)args;
+    for (int i = 0; i < watch_count; i++) {
+        fprintf(out, "%d %s\n", watches[i].wd, watches[i].path);
+    }
+    return NULL;
+}
+
+/**
+ * BACKLOG: kernel queue and lane statistics
+ */
+const char *control_backlog(const char *command, char *args, FILE *out) {
+    (void)command;
+    (void)args;
+    backlog_stats st;
+    backlog_get_stats(&st);
+    fprintf(out, "level %s\n", backlog_level_name(st.level));
+    fprintf(out, "pending_bytes %u\n", st.bytes);
+    fprintf(out, "pending_events %u\n", st.events);
+    fprintf(out, "max_queued_events %u\n", st.max_queued);
+    fprintf(out, "fill %.3f\n", st.fill);
+    fprintf(out, "peak_fill %.3f\n", st.peak_fill);
+    fprintf(out, "coalesced %llu\n", (unsigned long long)st.coalesced);
+    fprintf(out, "overflows %llu\n", (unsigned long long)st.overflows);
+    fprintf(out, "queued %u\n", lanes_pending());
+    return NULL;
+}
+
+/**
+ * USAGE PATH: disk usage totals for a tracked subtree
+ */
+const char *control_usage(const char *command, char *args, FILE *out) {
+    (void)command;
+    usage_totals t;
+    if (!usage_tracking) {
+        return "usage tracking is off";
+    }
+    if (*args == '\0') {
+        return "usage: USAGE PATH";
+    }
+    if (usage_query(args, &t) < 0) {
+        return "not tracked";
+    }
+    fprintf(out, "bytes %llu\n", (unsigned long long)t.bytes);
+    fprintf(out, "apparent_bytes %llu\n", (unsigned long long)t.apparent);
+    fprintf(out, "files %llu\n", (unsigned long long)t.files);
+    fprintf(out, "dirs %llu\n", (unsigned long long)t.dirs);
+    return NULL;
+}
+
+/**
+ * SCRUB: consistency scrubber statistics
+ */
+const char *control_scrub(const char *command, char *args, FILE *out) {
+    (void)command;
+    (void)args;
+    scrub_stats st;
+    if (!scrub_rate) {
+        return "scrubbing is off";
+    }
+    scrub_get_stats(&st);
+    fprintf(out, "passes %llu\n", (unsigned long long)scrub_passes);
+    fprintf(out, "dirs %llu\n", (unsigned long long)st.dirs);
+    fprintf(out, "entries %llu\n", (unsigned long long)st.entries);
+    fprintf(out, "suspects %llu\n", (unsigned long long)st.suspects);
+    fprintf(out, "corrections %llu\n", (unsigned long long)st.corrections);
+    return NULL;
+}
+
+/**
+ * EXECUTORS: per-helper ring and restart statistics
+ */
+const char *control_executors(const char *command, char *args, FILE *out) {
+    (void)command;
+    (void)args;
+    if (!executor_count()) {
+        return "callbacks run inline";
+    }
+    executor_report(out);
+    return NULL;
+}
+
+/**
+ * FILEIDS: file identity cache statistics
+ */
+const char *control_fileids(const char *command, char *args, FILE *out) {
+    (void)command;
+    (void)args;
+    uint32_t cached;
+    uint64_t lookups, resolved;
+    if (!file_ids) {
+        return "file ids are off";
+    }
+    file_id_stats(&cached, &lookups, &resolved);
+    fprintf(out, "cached %u\n", cached);
+    fprintf(out, "lookups %llu\n", (unsigned long long)lookups);
+    fprintf(out, "resolved %llu\n", (unsigned long long)resolved);
+    return NULL;
+}
+
+/**
+ * ID STRING | NAME ID: look up the intern table in either direction
+ */
+const char *control_intern(const char *command, char *args, FILE *out) {
+    if (*args == '\0') {
+        return "usage: ID STRING | NAME ID";
+    }
+    if (strcasecmp(command, "ID") == 0) {
+        uint32_t id = intern_find(args);
+        if (id == INTERN_NONE) {
+            return "not interned";
+        }
+        fprintf(out, "%u\n", id);
+    } else {
+        char *end;
+        unsigned long id = strtoul(args, &end, 10);
+        const char *s = *end == '\0' && id < INTERN_NONE ? intern_string((uint32_t)id) : NULL;
+        if (!s) {
+            return "unknown id";
+        }
+        fprintf(out, "%s\n", s);
+    }
+    return NULL;
+}
+
+/**
+ * ADD PATH: watch another root
+ */
+const char *control_add(const char *command, char *args, FILE *out) {
+    struct stat st;
+    (void)command;
+    if (*args == '\0') {
+        return "usage: ADD PATH";
+    }
+    if (stat(args, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        return "not a directory";
+    }
+    for (int i = 0; i < watch_count; i++) {
+        if (strcmp(watches[i].path, args) == 0) {
+            return "already watched";
+        }
+    }
+    
+    // nftw visits the root itself, so it is watched exactly once either way
+    int before = watch_count;
+    if (recursive_mode) {
+        watch_recursively(args);
+    } else {
+        add_watch(args);
+    }
+    if (watch_count == before) {
+        return "failed to add watch";
+    }
+    if (index_file) {
+        trigram_index_add_tree(args);
+    }
+    // The new root gets its own baseline, kept in memory (the baseline
+    // file only ever describes the startup root)
+    if (integrity_file) {
+        int files = integrity_add_tree(args, recursive_mode, hash_threads, matches_pattern);
+        if (files >= 0) {
+            fprintf(out, "%d files added to integrity baseline\n", files);
+        }
+    }
+    if (usage_tracking && usage_add_root(args) < 0) {
+        fprintf(out, "failed to measure usage\n");
+    }
+    
+    fprintf(out, "%d watches added\n", watch_count - before);
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Control: added root %s", args);
+    } else {
+        printf("Control: added root %s\n", args);
+    }
     return NULL;
 }
 
 /**
- * Recursively add watches for a directory and all its subdirectories
+ * REMOVE PATH: stop watching a root and everything below it
  */
-static int ftw_callback(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
-    if (typeflag == FTW_D && ftwbuf->level >= 0) {  // Directory and not the root (which is already watched)
-        add_watch(path);
+const char *control_remove(const char *command, char *args, FILE *out) {
+    (void)command;
+    if (*args == '\0') {
+        return "usage: REMOVE PATH";
     }
-    return 0;  // Continue traversal
-}
-
-void watch_recursively(const char *path) {
-    if (nftw(path, ftw_callback, 16, FTW_PHYS) == -1) {
-        if (daemon_mode) {
-            syslog(LOG_ERR, "Failed to recursively watch %s: %s", path, strerror(errno));
-        } else {
-            fprintf(stderr, "Failed to recursively watch %s: %s\n", path, strerror(errno));
-        }
+    int removed = remove_watch_tree(args);
+    if (removed == 0) {
+        return "not watched";
+    }
+    if (index_file) {
+        trigram_index_remove_tree(args);
+    }
+    if (integrity_file) {
+        integrity_remove_tree(args);
     }
+    if (usage_tracking) {
+        usage_remove_root(args);
+    }
+    
+    fprintf(out, "%d watches removed\n", removed);
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Control: removed root %s", args);
+    } else {
+        printf("Control: removed root %s\n", args);
+    }
+    return NULL;
 }
 
 /**
- * Check if a file matches any of the patterns
+ * PATTERNS | EXCLUDES GLOB...: replace a pattern list
  */
-int matches_pattern(const char *filename) {
-    if (pattern_count == 0) {
-        return 1;  // No patterns means match everything
+const char *control_patterns(const char *command, char *args, FILE *out) {
+    (void)out;
+    int rc = strcasecmp(command, "PATTERNS") == 0
+                 ? replace_pattern_list(&patterns, &pattern_count, &pattern_store, args)
+                 : replace_pattern_list(&excludes, &exclude_count, &exclude_store, args);
+    if (rc < 0) {
+        return "out of memory";
     }
     
-    for (int i = 0; i < pattern_count; i++) {
-        if (fnmatch(patterns[i], filename, 0) == 0) {
-            return 1;
-        }
+    if (matcher_active) {
+        pattern_free(&matcher);
+        matcher_active = 0;
+    }
+    int loaded = load_patterns();
+    refresh_interest();
+    if (loaded < 0) {
+        return "failed to compile patterns (matching everything)";
     }
     
-    return 0;
+    if (daemon_mode) {
+        syslog(LOG_INFO, "Control: %s set to \"%s\"", command, args);
+    } else {
+        printf("Control: %s set to \"%s\"\n", command, args);
+    }
+    return NULL;
 }
 
+// Commands accepted on the control socket, in the order the help lists them
+static const struct {
+    const char *name;
+    int path_arg;               // Argument is a path: trailing '/' is stripped
+    control_handler handler;
+} control_commands[] = {
+    { "ADD", 1, control_add },
+    { "REMOVE", 1, control_remove },
+    { "LIST", 0, control_list },
+    { "PATTERNS", 0, control_patterns },
+    { "EXCLUDES", 0, control_patterns },
+    { "USAGE", 1, control_usage },
+    { "BACKLOG", 0, control_backlog },
+    { "SCRUB", 0, control_scrub },
+    { "FILEIDS", 0, control_fileids },
+    { "EXECUTORS", 0, control_executors },
+    { "ID", 0, control_intern },
+    { "NAME", 0, control_intern },
+};
+#define CONTROL_COMMANDS (sizeof(control_commands) / sizeof(control_commands[0]))
+
 /**
- * Process an event and trigger appropriate callbacks
+ * Run a command received on the control socket
  */
-void process_event(uint32_t event_mask, const char *path, const char *filename) {
-    // Check if this is a new directory and we're in recursive mode
-    if (recursive_mode && (event_mask & IN_CREATE) && (event_mask & IN_ISDIR)) {
-        char full_path[PATH_MAX];
-        snprintf(full_path, PATH_MAX, "%s/%s", path, filename);
-        add_watch(full_path);
+const char *handle_control(const char *command, char *args, FILE *out) {
+    static char unknown[256];
+    
+    for (size_t i = 0; i < CONTROL_COMMANDS; i++) {
+        if (strcasecmp(command, control_commands[i].name) != 0) {
+            continue;
+        }
         
-        if (daemon_mode) {
-            syslog(LOG_INFO, "Added watch for new directory: %s", full_path);
-        } else {
-            printf("Added watch for new directory: %s\n", full_path);
+        // Paths are compared with watch paths, which never end in '/'; other
+        // arguments (globs, interned strings) are taken as given
+        if (control_commands[i].path_arg) {
+            size_t len = strlen(args);
+            while (len > 1 && args[len - 1] == '/') {
+                args[--len] = '\0';
+            }
         }
+        return control_commands[i].handler(command, args, out);
     }
     
-    // Log the event if in daemon mode
-    if (daemon_mode) {
-        if (event_mask & IN_CREATE)
-            syslog(LOG_INFO, "File created: %s/%s", path, filename);
-        if (event_mask & IN_DELETE)
-            syslog(LOG_INFO, "File deleted: %s/%s", path, filename);
-        if (event_mask & IN_MODIFY)
-            syslog(LOG_INFO, "File modified: %s/%s", path, filename);
-        if (event_mask & IN_MOVED_FROM)
-            syslog(LOG_INFO, "File moved from: %s/%s", path, filename);
-        if (event_mask & IN_MOVED_TO)
-            syslog(LOG_INFO, "File moved to: %s/%s", path, filename);
-    }
-    
-    // Process through callbacks
-    for (int i = 0; i < callback_count; i++) {
-        // Check if event mask matches
-        if (callbacks[i].mask & event_mask) {
-            // Check if pattern matches
-            if (!callbacks[i].pattern || 
-                fnmatch(callbacks[i].pattern, filename, 0) == 0) {
-                callbacks[i].callback(path, filename);
-            }
+    // Listed from the table so a new command cannot be left out
+    if (unknown[0] == '\0') {
+        size_t used = snprintf(unknown, sizeof(unknown), "unknown command (");
+        for (size_t i = 0; i < CONTROL_COMMANDS && used < sizeof(unknown); i++) {
+            used += snprintf(unknown + used, sizeof(unknown) - used, "%s%s",
+                             i ? ", " : "", control_commands[i].name);
+        }
+        if (used < sizeof(unknown)) {
+            snprintf(unknown + used, sizeof(unknown) - used, ")");
         }
     }
+    return unknown;
 }
 
 /**
  * Clean up all resources
  */
 void cleanup() {
+    // A callback that called exit() in an executor: the daemon's state is
+    // not this process's to tear down
+    if (executor_is_helper()) {
+        return;
+    }
+    
+    // Deliver events still held for an unfinished git operation while
+    // callbacks, indexes and snapshots can still take them
+    if (git_aware) {
+        git_guard_flush(now_ms(), 1, report_git_batch, deliver_git_event);
+    }
+    
     // Remove all watches
     for (int i = 0; i < watch_count; i++) {
         inotify_rm_watch(fd, watches[i].wd);
@@ -223,8 +1671,54 @@ void cleanup() {
     for (int i = 0; i < callback_count; i++) {
         free(callbacks[i].pattern);
     }
+    path_radix_free(&callback_routes);
+    
+    if (matcher_active) {
+        pattern_free(&matcher);
+    }
+    free(excludes);
+    free(callback_scopes);
+    free(exclude_store);
+    if (pattern_store) {
+        free(patterns);
+        free(pattern_store);
+    }
+    
+    control_close();
+    
+    integrity_cleanup();
+    
+    if (index_file) {
+        save_index(1);
+        trigram_index_cleanup();
+    }
+    
+    if (merkle_file) {
+        save_merkle(1);
+        merkle_cleanup();
+    }
+    
+    usage_cleanup();
+    file_id_cleanup();
+    scrub_cleanup();
+    
+    // Let executors finish what they were handed
+    if (executor_count()) {
+        executor_stop();
+    }
+    
+    git_guard_cleanup();
+    lanes_cleanup();
+    summary_cleanup();
+    intern_cleanup();
+    timer_wheel_cleanup();
+    
+    if (sample_fraction) {
+        report_sampling(1);
+    }
 }
 
+#if FSW_EXAMPLE_CALLBACKS
 /**
  * Example callbacks
  */
@@ -248,6 +1742,36 @@ void on_file_modified(const char *path, const char *filename) {
     }
     // Add custom logic here
 }
+#endif
+
+/**
+ * Register one of the built-in callbacks, limited to the --scope subtrees
+ */
+void register_builtin_callback(uint32_t event_mask, event_callback cb) {
+    int slot = register_callback(event_mask, NULL, cb);
+    for (int i = 0; slot >= 0 && i < callback_scope_count; i++) {
+        if (add_callback_scope(slot, callback_scopes[i]) < 0) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Parse a byte count with an optional K, M or G suffix
+ */
+size_t parse_size(const char *arg) {
+    char *end;
+    unsigned long long value = strtoull(arg, &end, 10);
+    
+    switch (*end) {
+        case 'G': case 'g': value <<= 10; // fall through
+        case 'M': case 'm': value <<= 10; // fall through
+        case 'K': case 'k': value <<= 10; break;
+        default: break;
+    }
+    return (size_t)value;
+}
 
 /**
  * Print usage information
@@ -258,11 +1782,66 @@ void print_usage(const char *program_name) {
     printf("  -d, --daemon        Run as a daemon\n");
     printf("  -r, --recursive     Watch directories recursively\n");
     printf("  -p, --pid=FILE      PID file location (default: %s)\n", DEFAULT_PID_FILE);
+    printf("  -I, --integrity=FILE  Report content changes against a hash baseline\n");
+    printf("                      (built and saved to FILE if it does not exist)\n");
+    printf("  -x, --index=FILE    Maintain a trigram index of text files for fsgrep\n");
+    printf("  -M, --merkle=FILE   Maintain a Merkle tree of the watched tree in FILE for\n");
+    printf("                      fast replica comparison with fsdiff (requires -r, no -c)\n");
+    printf("  -u, --usage         Keep per-directory disk usage current for USAGE queries\n");
+    printf("                      on the control socket (requires -r)\n");
+    printf("  -g, --git-aware     Batch worktree events during git operations and\n");
+    printf("                      ignore .git internals\n");
+    printf("  -P, --priority=LEVEL:SPEC  Route events for SPEC (directory prefix if it\n");
+    printf("                      contains '/', filename glob otherwise) to lane LEVEL\n");
+    printf("                      (critical, high, normal, low); higher lanes drain first\n");
+    printf("  -Q, --queue-memory=SIZE  Queue events internally within SIZE bytes (K/M/G),\n");
+    printf("                      spilling the excess to disk and reading it back in order\n");
+    printf("  -S, --spill-dir=DIR Directory for queue spill files (default: $TMPDIR or /tmp)\n");
+    printf("  -s, --summary=SECONDS  Instead of one line per event, print per-directory\n");
+    printf("                      event counts for every SECONDS-long window\n");
+    printf("  -f, --sample=FRACTION  Only process a stable, path-hashed FRACTION (0-1]\n");
+    printf("                      of files and report counts to extrapolate totals\n");
+    printf("  -B, --benchmark=N   Replay N synthetic events through the pipeline, print\n");
+    printf("                      throughput to stderr and exit\n");
+    printf("  -e, --exclude=GLOB  Ignore files matching GLOB (may be repeated)\n");
+    printf("  -w, --scope=DIR     Run the built-in callbacks only for events in DIR and\n");
+    printf("                      below (may be repeated); other watches stop asking the\n");
+    printf("                      kernel for events only those callbacks wanted\n");
+    printf("  -i, --ignore-case   Match patterns and excludes case-insensitively (ASCII)\n");
+    printf("  -C, --pattern-cache=FILE  Reuse compiled patterns from FILE when the\n");
+    printf("                      configuration is unchanged (rewritten otherwise)\n");
+    printf("  -c, --control=SOCKET  Accept ADD, REMOVE, LIST, PATTERNS, EXCLUDES,\n");
+    printf("                      USAGE, BACKLOG, SCRUB, FILEIDS, EXECUTORS, ID and\n");
+    printf("                      NAME commands on a Unix socket\n");
+    printf("  -R, --crawl-rate=N  Crawl at most N directories per second at startup,\n");
+    printf("                      slowing further while directory reads get slower\n");
+    printf("  -N, --crawl-idle    Crawl and hash at startup in the idle I/O class\n");
+    printf("  -D, --settle=MS     Report each changed file once it has been quiet for MS\n");
+    printf("                      milliseconds (restarted by every further change)\n");
+    printf("  -z, --scrub=N       Re-check N directories per second against what events\n");
+    printf("                      reported, replaying any changes that were missed\n");
+    printf("  -F, --file-ids      Tag events with a stable file id that survives renames\n");
+    printf("  -X, --isolate=N     Run callbacks in N helper processes, restarted if they\n");
+    printf("                      crash, instead of inside the daemon\n");
+    printf("  -j, --hash-threads=N  Threads used to hash/index at startup (default: auto)\n");
     printf("  -h, --help          Display this help message\n");
     printf("\nExamples:\n");
     printf("  %s /home/user/docs             # Watch all files in docs\n", program_name);
     printf("  %s -r /var/log \"*.log\"         # Watch log files recursively\n", program_name);
     printf("  %s -d -p /tmp/fw.pid /etc      # Watch /etc as a daemon\n", program_name);
+    printf("  %s -r -I /var/lib/etc.fwib /etc  # Detect unauthorized changes\n", program_name);
+    printf("  %s -r -x /tmp/src.idx ~/src \"*.c\"  # Index sources for fsgrep\n", program_name);
+    printf("  %s -r -M /var/lib/data.fwmk /data  # Compare with fsdiff\n", program_name);
+    printf("  %s -r -u -c /run/fsw.sock /data  # echo \"USAGE /data/a\" | nc -U /run/fsw.sock\n", program_name);
+    printf("  %s -r -P critical:/srv/app/config /srv/app  # Config changes first\n", program_name);
+    printf("  %s -r -s 60 /data                # Per-directory counts every minute\n", program_name);
+    printf("  %s -r -f 0.01 -s 60 /shared      # Trends from a 1%% sample\n", program_name);
+    printf("  %s -r -e \"*.tmp\" -e \"*~\" ~/src    # Ignore editor/temp files\n", program_name);
+    printf("  %s -r -w /srv/app/config /srv/app  # Callbacks for config changes only\n", program_name);
+    printf("  %s -r -c /run/fsw.sock /srv/ws  # echo \"ADD /srv/ws2\" | nc -U /run/fsw.sock\n", program_name);
+    printf("  %s -r -N -R 200 /nfs/shared      # Gentle startup on a busy disk\n", program_name);
+    printf("  %s -r -D 5000 /srv/incoming    # Files finished uploading\n", program_name);
+    printf("  %s -i /mnt/share \"*.csv\"         # Matches REPORT.CSV and report.csv\n", program_name);
 }
 
 /**
@@ -278,11 +1857,34 @@ int main(int argc, char **argv) {
         {"daemon",    no_argument,       NULL, 'd'},
         {"recursive", no_argument,       NULL, 'r'},
         {"pid",       required_argument, NULL, 'p'},
+        {"integrity", required_argument, NULL, 'I'},
+        {"index",     required_argument, NULL, 'x'},
+        {"merkle",    required_argument, NULL, 'M'},
+        {"usage",     no_argument,       NULL, 'u'},
+        {"git-aware", no_argument,       NULL, 'g'},
+        {"priority",  required_argument, NULL, 'P'},
+        {"queue-memory", required_argument, NULL, 'Q'},
+        {"spill-dir", required_argument, NULL, 'S'},
+        {"summary",   required_argument, NULL, 's'},
+        {"sample",    required_argument, NULL, 'f'},
+        {"benchmark", required_argument, NULL, 'B'},
+        {"exclude",   required_argument, NULL, 'e'},
+        {"scope",     required_argument, NULL, 'w'},
+        {"pattern-cache", required_argument, NULL, 'C'},
+        {"ignore-case", no_argument,     NULL, 'i'},
+        {"control",   required_argument, NULL, 'c'},
+        {"crawl-rate", required_argument, NULL, 'R'},
+        {"crawl-idle", no_argument,      NULL, 'N'},
+        {"settle",    required_argument, NULL, 'D'},
+        {"scrub",     required_argument, NULL, 'z'},
+        {"file-ids",  no_argument,       NULL, 'F'},
+        {"isolate",   required_argument, NULL, 'X'},
+        {"hash-threads", required_argument, NULL, 'j'},
         {"help",      no_argument,       NULL, 'h'},
         {NULL,        0,                 NULL, 0}
     };
     
-    while ((opt = getopt_long(argc, argv, "drp:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "drp:I:x:M:ugP:Q:S:s:f:B:e:C:ic:R:ND:Fz:X:w:j:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'd':
                 daemon_mode = 1;
@@ -293,6 +1895,122 @@ int main(int argc, char **argv) {
             case 'p':
                 pid_file = optarg;
                 break;
+            case 'I':
+                integrity_file = optarg;
+                watch_mask |= IN_CLOSE_WRITE;
+                break;
+            case 'x':
+                index_file = optarg;
+                watch_mask |= IN_CLOSE_WRITE;
+                break;
+            case 'M':
+                merkle_file = optarg;
+                watch_mask |= IN_CLOSE_WRITE;
+                break;
+            case 'u':
+                usage_tracking = 1;
+                watch_mask |= IN_CLOSE_WRITE;
+                break;
+            case 'g':
+                git_aware = 1;
+                break;
+            case 'P':
+                if (lanes_add_rule(optarg) < 0) {
+                    fprintf(stderr, "Error: invalid priority rule '%s'\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'Q':
+                queue_memory = parse_size(optarg);
+                break;
+            case 'S':
+                spill_dir = optarg;
+                break;
+            case 's':
+                summary_interval = atoi(optarg);
+                if (summary_interval <= 0) {
+                    fprintf(stderr, "Error: summary interval must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f':
+                sample_fraction = atof(optarg);
+                if (sampling_init(sample_fraction) < 0) {
+                    fprintf(stderr, "Error: sample fraction must be in (0, 1]\n");
+                    exit(EXIT_FAILURE);
+                }
+                sample_reported_at = time(NULL);
+                break;
+            case 'B':
+                benchmark_events = strtoull(optarg, NULL, 10);
+                break;
+            case 'e': {
+                char **grown = realloc(excludes, (exclude_count + 1) * sizeof(*excludes));
+                if (!grown) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(EXIT_FAILURE);
+                }
+                excludes = grown;
+                excludes[exclude_count++] = optarg;
+                break;
+            }
+            case 'w': {
+                char **grown = realloc(callback_scopes, (callback_scope_count + 1) * sizeof(*callback_scopes));
+                if (!grown) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(EXIT_FAILURE);
+                }
+                callback_scopes = grown;
+                callback_scopes[callback_scope_count++] = optarg;
+                break;
+            }
+            case 'C':
+                pattern_cache_file = optarg;
+                break;
+            case 'i':
+                ignore_case = 1;
+                break;
+            case 'c':
+                control_socket = optarg;
+                break;
+            case 'R':
+                crawl_rate = atof(optarg);
+                if (crawl_rate <= 0) {
+                    fprintf(stderr, "Error: crawl rate must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'N':
+                crawl_idle_io = 1;
+                break;
+            case 'D':
+                settle_ms = strtoull(optarg, NULL, 10);
+                if (!settle_ms) {
+                    fprintf(stderr, "Error: settle time must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                watch_mask |= IN_CLOSE_WRITE;
+                break;
+            case 'z':
+                scrub_rate = atof(optarg);
+                if (scrub_rate <= 0) {
+                    fprintf(stderr, "Error: scrub rate must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'F':
+                file_ids = 1;
+                break;
+            case 'X':
+                executor_procs = atoi(optarg);
+                if (executor_procs <= 0) {
+                    fprintf(stderr, "Error: executor count must be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'j':
+                hash_threads = atoi(optarg);
+                break;
             case 'h':
                 print_usage(argv[0]);
                 exit(EXIT_SUCCESS);
@@ -302,6 +2020,41 @@ int main(int argc, char **argv) {
         }
     }
     
+    // Queue events when lanes or a memory budget are in use
+    queue_events = lanes_has_rules() || queue_memory > 0;
+    if (queue_memory) {
+        if (!spill_dir) {
+            spill_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+        }
+        lanes_set_budget(queue_memory, spill_dir);
+    }
+    
+    // Preallocate the summary table so counting never allocates
+    if (summary_interval) {
+        if (summary_init(MAX_WATCHES) < 0) {
+            fprintf(stderr, "Failed to allocate summary table\n");
+            exit(EXIT_FAILURE);
+        }
+        time_t now = time(NULL);
+        summary_window_end = (now / summary_interval + 1) * summary_interval;
+    }
+    
+    // Directory hashes are only meaningful if every level is watched
+    if (merkle_file && !recursive_mode) {
+        fprintf(stderr, "Error: --merkle requires --recursive\n");
+        exit(EXIT_FAILURE);
+    }
+    if (usage_tracking && !recursive_mode) {
+        fprintf(stderr, "Error: --usage requires --recursive\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    // The snapshot file holds a single tree, so roots cannot come and go
+    if (merkle_file && control_socket) {
+        fprintf(stderr, "Error: --merkle cannot be used with --control\n");
+        exit(EXIT_FAILURE);
+    }
+    
     // Get watch path from remaining arguments
     if (optind < argc) {
         watch_path = argv[optind++];
@@ -324,10 +2077,36 @@ int main(int argc, char **argv) {
         }
     }
     
+    if (load_patterns() < 0) {
+        fprintf(stderr, "Failed to compile patterns\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    if (path_radix_init(&callback_routes) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    
+#if FSW_EXAMPLE_CALLBACKS
     // Register example callbacks
-    register_callback(IN_CREATE, NULL, on_file_created);
-    register_callback(IN_DELETE, NULL, on_file_deleted);
-    register_callback(IN_MODIFY, NULL, on_file_modified);
+    register_builtin_callback(IN_CREATE, on_file_created);
+    register_builtin_callback(IN_DELETE, on_file_deleted);
+    register_builtin_callback(IN_MODIFY, on_file_modified);
+#endif
+    if (benchmark_events) {
+        register_builtin_callback(OUTPUT_EVENTS, count_benchmark_event);
+    }
+    
+    if (scrub_rate && scrub_init() < 0) {
+        fprintf(stderr, "Failed to allocate scrub state\n");
+        exit(EXIT_FAILURE);
+    }
+    scrub_refilled_at = now_ms();
+    
+    if (file_ids && file_id_init() < 0) {
+        fprintf(stderr, "Failed to allocate file id cache\n");
+        exit(EXIT_FAILURE);
+    }
     
     // Set up atexit handler for cleanup
     atexit(cleanup);
@@ -359,6 +2138,12 @@ int main(int argc, char **argv) {
         }
         exit(EXIT_FAILURE);
     }
+    backlog_init(fd);
+    timer_wheel_init(now_ms());
+    
+    // Everything up to the main loop walks the tree; keep it off the disk's critical path
+    crawl_throttle_init(crawl_rate, crawl_idle_io);
+    crawl_begin();
     
     // Add watch for the specified path
     int initial_wd = add_watch(watch_path);
@@ -366,6 +2151,16 @@ int main(int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
     
+    // Watch the repository's .git directory for lock files even when not recursing
+    if (git_aware && !recursive_mode) {
+        char git_dir[PATH_MAX];
+        struct stat st;
+        snprintf(git_dir, PATH_MAX, "%s/.git", watch_path);
+        if (stat(git_dir, &st) == 0 && S_ISDIR(st.st_mode)) {
+            add_watch(git_dir);
+        }
+    }
+    
     // If recursive mode is enabled, add watches for all subdirectories
     if (recursive_mode) {
         if (!daemon_mode) {
@@ -379,12 +2174,204 @@ int main(int argc, char **argv) {
         }
     }
     
+    // Load the integrity baseline, or hash the tree to create one
+    if (integrity_file) {
+        int files = integrity_load_baseline(integrity_file);
+        if (files < 0 && errno == ENOENT) {
+            files = integrity_build_baseline(watch_path, recursive_mode, hash_threads,
+                                             matches_pattern);
+            if (files >= 0 && integrity_save_baseline(integrity_file) < 0) {
+                if (daemon_mode) {
+                    syslog(LOG_ERR, "Failed to save baseline %s: %s", integrity_file, strerror(errno));
+                } else {
+                    fprintf(stderr, "Failed to save baseline %s: %s\n", integrity_file, strerror(errno));
+                }
+            }
+        }
+        
+        if (files < 0) {
+            if (daemon_mode) {
+                syslog(LOG_ERR, "Failed to load baseline %s: %s", integrity_file, strerror(errno));
+            } else {
+                fprintf(stderr, "Failed to load baseline %s: %s\n", integrity_file, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+        
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Integrity baseline: %d files", files);
+        } else {
+            printf("Integrity baseline: %d files\n", files);
+        }
+    }
+    
+    // Build the trigram index over the current tree
+    if (index_file) {
+        int files = trigram_index_build(watch_path, recursive_mode, hash_threads, matches_pattern);
+        if (files < 0 || trigram_index_save(index_file) < 0) {
+            if (daemon_mode) {
+                syslog(LOG_ERR, "Failed to build index %s: %s", index_file, strerror(errno));
+            } else {
+                fprintf(stderr, "Failed to build index %s: %s\n", index_file, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+        index_saved_at = time(NULL);
+        
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Indexed %d text files", files);
+        } else {
+            printf("Indexed %d text files\n", files);
+        }
+    }
+    
+    // Hash the current tree
+    if (merkle_file) {
+        int nodes = merkle_build(watch_path, git_aware);
+        if (nodes < 0 || merkle_save(merkle_file) < 0) {
+            if (daemon_mode) {
+                syslog(LOG_ERR, "Failed to build Merkle tree %s: %s", merkle_file, strerror(errno));
+            } else {
+                fprintf(stderr, "Failed to build Merkle tree %s: %s\n", merkle_file, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+        merkle_saved_at = time(NULL);
+        
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Merkle tree: %d entries, root %016llx", nodes,
+                   (unsigned long long)merkle_root_hash());
+        } else {
+            printf("Merkle tree: %d entries, root %016llx\n", nodes,
+                   (unsigned long long)merkle_root_hash());
+        }
+    }
+    
+    // Measure the tree once; events keep it current from here on
+    if (usage_tracking) {
+        usage_totals t;
+        int entries = usage_build(watch_path);
+        if (entries < 0 || usage_query(watch_path, &t) < 0) {
+            if (daemon_mode) {
+                syslog(LOG_ERR, "Failed to measure disk usage of %s: %s", watch_path, strerror(errno));
+            } else {
+                fprintf(stderr, "Failed to measure disk usage of %s: %s\n", watch_path, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+        
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Disk usage: %llu bytes in %llu files, %llu directories",
+                   (unsigned long long)t.bytes, (unsigned long long)t.files, (unsigned long long)t.dirs);
+        } else {
+            printf("Disk usage: %llu bytes in %llu files, %llu directories\n",
+                   (unsigned long long)t.bytes, (unsigned long long)t.files, (unsigned long long)t.dirs);
+        }
+    }
+    
+    crawl_end();
+    if (crawl_rate > 0) {
+        uint64_t dirs, slept_ms;
+        double rate;
+        crawl_stats(&dirs, &slept_ms, &rate);
+        if (daemon_mode) {
+            syslog(LOG_INFO, "Startup crawl: %llu directories, throttled for %llu ms, final rate %.0f/s",
+                   (unsigned long long)dirs, (unsigned long long)slept_ms, rate);
+        } else {
+            printf("Startup crawl: %llu directories, throttled for %llu ms, final rate %.0f/s\n",
+                   (unsigned long long)dirs, (unsigned long long)slept_ms, rate);
+        }
+    }
+    
+    // Callbacks are all registered by now; helpers inherit them at fork
+    if (executor_procs && executor_start(executor_procs, EXECUTOR_RING_BYTES, run_callbacks, detach_executor) < 0) {
+        if (daemon_mode) {
+            syslog(LOG_ERR, "Failed to start executors: %s", strerror(errno));
+        } else {
+            fprintf(stderr, "Failed to start executors: %s\n", strerror(errno));
+        }
+        exit(EXIT_FAILURE);
+    }
+    
+    if (benchmark_events) {
+        run_benchmark();
+        exit(EXIT_SUCCESS);
+    }
+    
+    // Open the control socket last, once the watch registry is in place
+    if (control_socket) {
+        if (control_open(control_socket) < 0) {
+            if (daemon_mode) {
+                syslog(LOG_ERR, "Failed to open control socket %s: %s", control_socket, strerror(errno));
+            } else {
+                fprintf(stderr, "Failed to open control socket %s: %s\n", control_socket, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+    }
+    
     // Buffer for reading events
     char buffer[BUF_LEN];
+    struct pollfd pfds[1 + CONTROL_POLLFDS] = {
+        { .fd = fd, .events = POLLIN }
+    };
+    
+    static const uint32_t drain_batch[] = { LANE_BATCH, LANE_BATCH / 4, LANE_BATCH / 16 };
+    static event_batch batch;
     
     // Main event loop
     while (1) {
         int i = 0;
+        
+        // Control clients come and go, so their descriptors are refreshed every pass
+        nfds_t nfds = 1 + (nfds_t)control_pollfds(pfds + 1);
+        
+        // Wake up periodically even when the tree is quiet; don't sleep on a backlog
+        int ready = poll(pfds, nfds, lanes_pending() ? 0 : poll_timeout());
+        if (ready < 0 && errno != EINTR) {
+            if (daemon_mode) {
+                syslog(LOG_ERR, "Poll error: %s", strerror(errno));
+            } else {
+                perror("poll");
+            }
+            exit(EXIT_FAILURE);
+        }
+        
+        run_periodic_tasks();
+        
+        // How far behind the kernel queue are we?
+        backlog_level level = backlog_sample();
+        if (level != backlog_reported) {
+            report_backlog(level);
+        }
+        
+        // Re-check the tree slowly while caught up
+        if (scrub_rate) {
+            run_scrub();
+        }
+        
+        // Work through queued events, most urgent lane first, before reading more;
+        // the closer the kernel queue is to overflowing, the sooner we go back to it
+        if (lanes_pending()) {
+            lanes_drain(drain_batch[level], handle_event);
+        }
+        executor_flush();
+        if (ready <= 0) {
+            continue;
+        }
+        
+        // Commands are applied between reads, so no event sees a half-updated
+        // registry; clients are never waited on, only served what they have sent
+        for (nfds_t c = 1; c < nfds; c++) {
+            if (pfds[c].revents) {
+                control_serve(handle_control);
+                break;
+            }
+        }
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
+        
         int length = read(fd, buffer, BUF_LEN);
         
         if (length < 0) {
@@ -396,44 +2383,24 @@ int main(int argc, char **argv) {
             exit(EXIT_FAILURE);
         }
         
-        // Process events
+        // Decode the buffer into columns, then process events or sort them into lanes
+        uint32_t events = 0;
         while (i < length) {
-            struct inotify_event *event = (struct inotify_event *) &buffer[i];
-            
-            if (event->len) {
-                // Get the path for this watch descriptor
-                const char *path = get_path_by_wd(event->wd);
-                if (path) {
-                    // Check if the file matches any of our patterns
-                    if (matches_pattern(event->name)) {
-                        // Process the event
-                        process_event(event->mask, path, event->name);
-                        
-                        // Also print the raw event info if not in daemon mode
-                        if (!daemon_mode) {
-                            if (event->mask & IN_CREATE)
-                                printf("File created: %s/%s\n", path, event->name);
-                            if (event->mask & IN_DELETE)
-                                printf("File deleted: %s/%s\n", path, event->name);
-                            if (event->mask & IN_MODIFY)
-                                printf("File modified: %s/%s\n", path, event->name);
-                            if (event->mask & IN_MOVED_FROM)
-                                printf("File moved from: %s/%s\n", path, event->name);
-                            if (event->mask & IN_MOVED_TO)
-                                printf("File moved to: %s/%s\n", path, event->name);
-                        }
-                    }
-                } else {
-                    if (daemon_mode) {
-                        syslog(LOG_WARNING, "Received event for unknown watch descriptor: %d", event->wd);
-                    } else {
-                        fprintf(stderr, "Warning: Received event for unknown watch descriptor: %d\n", event->wd);
-                    }
-                }
+            size_t used = event_batch_decode(&batch, buffer + i, (size_t)(length - i));
+            if (used == 0) {
+                break;
             }
-            
-            i += EVENT_SIZE + event->len;
+            process_batch(&batch, buffer + i, level);
+            events += batch.count;
+            i += (int)used;
         }
+        
+        // A rename split across two reads is not paired
+        queue_held_move();
+        backlog_note_read((size_t)length, events);
+        
+        // Wake executors once for the whole read
+        executor_flush();
     }
     
     // This point will never be reached in this simple version
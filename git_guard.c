@@ -0,0 +1,254 @@
+// git_guard.c
+#include "git_guard.h"
+#include "path_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define MAX_GIT_REPOS   64
+#define GIT_SETTLE_MS   500         // Quiet time after the last lock is released
+#define GIT_STALE_MS    60000       // Give up on a lock left behind by a crashed git
+#define GIT_MAX_HELD    200000      // Flush early rather than buffer without bound
+
+// Reasons a repository is considered mid-operation
+#define HOLD_INDEX_LOCK 0x1
+#define HOLD_REBASE     0x2
+
+// A worktree event waiting for the operation to finish
+typedef struct {
+    char *path;
+    char *filename;
+    uint32_t mask;              // Union of all masks seen for this file
+    uint32_t cookie;            // Cookie of the latest move (0 = none)
+} held_event;
+
+// Per-repository state
+typedef struct {
+    char root[PATH_MAX];        // Worktree root (parent of .git)
+    size_t root_len;
+    int holds;                  // HOLD_* bits currently set
+    uint64_t started_ms;        // When the current operation began
+    uint64_t released_ms;       // When the last hold was dropped
+    int overflow;               // Too many events held, flush now
+    held_event *events;         // In first-seen order
+    uint32_t count;
+    uint32_t cap;
+    uint32_t raw;               // Events received before coalescing
+    path_map keys;              // "path/filename" -> index in events
+} git_repo;
+
+static git_repo repos[MAX_GIT_REPOS];
+static int repo_count = 0;
+
+int git_is_internal(const char *dir) {
+    size_t len = strlen(dir);
+    if (strcmp(dir, ".git") == 0 || strncmp(dir, ".git/", 5) == 0) {
+        return 1;
+    }
+    if (len >= 5 && strcmp(dir + len - 5, "/.git") == 0) {
+        return 1;
+    }
+    return strstr(dir, "/.git/") != NULL;
+}
+
+// Find (or create) the repository owning a .git directory
+static git_repo *repo_for_git_dir(const char *git_dir) {
+    char root[PATH_MAX];
+    size_t len = strlen(git_dir);
+
+    if (len < 4 || strcmp(git_dir + len - 4, ".git") != 0 || len - 4 >= PATH_MAX) {
+        return NULL;
+    }
+    len -= 4;
+    if (len > 0) {
+        len--;  // Drop the separator before .git
+    }
+    memcpy(root, git_dir, len);
+    root[len] = '\0';
+    if (len == 0) {
+        strcpy(root, ".");
+        len = 1;
+    }
+
+    for (int i = 0; i < repo_count; i++) {
+        if (strcmp(repos[i].root, root) == 0) {
+            return &repos[i];
+        }
+    }
+    if (repo_count == MAX_GIT_REPOS) {
+        return NULL;
+    }
+
+    git_repo *repo = &repos[repo_count];
+    memset(repo, 0, sizeof(*repo));
+    if (path_map_init(&repo->keys, 256) < 0) {
+        return NULL;
+    }
+    memcpy(repo->root, root, len + 1);
+    repo->root_len = len;
+    repo_count++;
+    return repo;
+}
+
+void git_guard_internal_event(const char *dir, const char *filename, uint32_t mask, uint64_t now_ms) {
+    int bit;
+    if (strcmp(filename, "index.lock") == 0) {
+        bit = HOLD_INDEX_LOCK;
+    } else if ((mask & IN_ISDIR) &&
+               (strcmp(filename, "rebase-merge") == 0 || strcmp(filename, "rebase-apply") == 0)) {
+        bit = HOLD_REBASE;
+    } else {
+        return;  // Objects, refs, logs... never reach the pipeline
+    }
+
+    git_repo *repo = repo_for_git_dir(dir);
+    if (!repo) {
+        return;
+    }
+
+    if (mask & (IN_CREATE | IN_MOVED_TO)) {
+        if (!repo->holds && !repo->count) {
+            repo->started_ms = now_ms;
+        }
+        repo->holds |= bit;
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        repo->holds &= ~bit;
+        if (!repo->holds) {
+            repo->released_ms = now_ms;
+        }
+    }
+}
+
+int git_guard_hold(const char *path, const char *filename, uint32_t mask, uint32_t cookie) {
+    git_repo *repo = NULL;
+    size_t path_len = strlen(path);
+
+    // Innermost active repository containing path
+    for (int i = 0; i < repo_count; i++) {
+        git_repo *r = &repos[i];
+        if (!r->holds && !r->count) {
+            continue;
+        }
+        int inside = strcmp(r->root, ".") == 0 ||
+                     (path_len >= r->root_len && strncmp(path, r->root, r->root_len) == 0 &&
+                      (path[r->root_len] == '\0' || path[r->root_len] == '/'));
+        if (inside && (!repo || r->root_len > repo->root_len)) {
+            repo = r;
+        }
+    }
+    if (!repo) {
+        return 0;
+    }
+
+    repo->raw++;
+
+    char key[PATH_MAX];
+    snprintf(key, sizeof(key), "%s/%s", path, filename);
+    uint32_t idx;
+    if (path_map_get(&repo->keys, key, &idx)) {
+        repo->events[idx].mask |= mask;
+        if (mask & (IN_MOVED_FROM | IN_MOVED_TO)) {
+            repo->events[idx].cookie = cookie;  // The latest move decides the final state
+        } else if (mask & (IN_CREATE | IN_DELETE)) {
+            repo->events[idx].cookie = 0;       // Another file by now, or none
+        }
+        return 1;
+    }
+
+    if (repo->count == repo->cap) {
+        uint32_t cap = repo->cap ? repo->cap * 2 : 256;
+        held_event *grown = realloc(repo->events, cap * sizeof(*grown));
+        if (!grown) {
+            return 0;  // Fall back to processing it immediately
+        }
+        repo->events = grown;
+        repo->cap = cap;
+    }
+
+    held_event *ev = &repo->events[repo->count];
+    ev->path = strdup(path);
+    ev->filename = strdup(filename);
+    if (!ev->path || !ev->filename || path_map_put(&repo->keys, key, repo->count) < 0) {
+        free(ev->path);
+        free(ev->filename);
+        return 0;
+    }
+    ev->mask = mask;
+    ev->cookie = cookie;
+    repo->count++;
+
+    if (repo->count >= GIT_MAX_HELD) {
+        repo->overflow = 1;
+    }
+    return 1;
+}
+
+// Deliver and forget all events held for one repository
+static void flush_repo(git_repo *repo, git_batch_cb report, git_deliver_cb deliver) {
+    report(repo->root, repo->raw, repo->count);
+
+    for (uint32_t i = 0; i < repo->count; i++) {
+        held_event *ev = &repo->events[i];
+        char full_path[PATH_MAX];
+        struct stat st;
+
+        // The final state of the file decides which parts of the history matter
+        snprintf(full_path, sizeof(full_path), "%s/%s", ev->path, ev->filename);
+        uint32_t mask = ev->mask;
+        if (lstat(full_path, &st) == 0) {
+            mask &= ~(IN_DELETE | IN_MOVED_FROM);
+        } else {
+            mask &= ~(IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB);
+        }
+
+        if (mask & ~IN_ISDIR) {
+            deliver(mask, ev->cookie, ev->path, ev->filename);
+        }
+        free(ev->path);
+        free(ev->filename);
+    }
+
+    path_map_free(&repo->keys);
+    path_map_init(&repo->keys, 256);
+    repo->count = 0;
+    repo->raw = 0;
+    repo->overflow = 0;
+}
+
+void git_guard_flush(uint64_t now_ms, int force, git_batch_cb report, git_deliver_cb deliver) {
+    for (int i = 0; i < repo_count; i++) {
+        git_repo *repo = &repos[i];
+        if (!repo->holds && !repo->count) {
+            continue;
+        }
+
+        int stale = repo->holds && now_ms - repo->started_ms >= GIT_STALE_MS;
+        int settled = !repo->holds && now_ms - repo->released_ms >= GIT_SETTLE_MS;
+        if (!force && !repo->overflow && !stale && !settled) {
+            continue;
+        }
+
+        if (stale) {
+            repo->holds = 0;  // Treat the lock as abandoned
+        }
+        if (repo->count) {
+            flush_repo(repo, report, deliver);
+        }
+        repo->started_ms = now_ms;
+    }
+}
+
+void git_guard_cleanup() {
+    for (int i = 0; i < repo_count; i++) {
+        for (uint32_t j = 0; j < repos[i].count; j++) {
+            free(repos[i].events[j].path);
+            free(repos[i].events[j].filename);
+        }
+        free(repos[i].events);
+        path_map_free(&repos[i].keys);
+    }
+    repo_count = 0;
+}
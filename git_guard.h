@@ -0,0 +1,33 @@
+// git_guard.h
+#ifndef GIT_GUARD_H
+#define GIT_GUARD_H
+
+#include <stdint.h>
+
+// Delivers one consolidated event after a git operation finishes. cookie is
+// the rename cookie of the last move held for the file (0 if none), so the
+// two halves of a rename still pair up.
+typedef void (*git_deliver_cb)(uint32_t mask, uint32_t cookie, const char *path,
+                               const char *filename);
+
+// Reports a finished operation before its events are delivered
+typedef void (*git_batch_cb)(const char *repo, uint32_t raw_events, uint32_t batched_events);
+
+// Is dir a .git directory or inside one?
+int git_is_internal(const char *dir);
+
+// Feed an event that happened inside a .git directory (lock/rebase tracking)
+void git_guard_internal_event(const char *dir, const char *filename, uint32_t mask, uint64_t now_ms);
+
+// Hold a worktree event while its repository is mid-operation.
+// Returns 1 if the event was buffered, 0 if it should be processed now.
+int git_guard_hold(const char *path, const char *filename, uint32_t mask, uint32_t cookie);
+
+// Deliver the batches of repositories whose operation has settled
+// (or all of them when force is set)
+void git_guard_flush(uint64_t now_ms, int force, git_batch_cb report, git_deliver_cb deliver);
+
+// Release all buffered events
+void git_guard_cleanup();
+
+#endif // GIT_GUARD_H
@@ -0,0 +1,264 @@
+// hash_utils.c
+#include "hash_utils.h"
+#include <string.h>
+
+/*
+ * SHA-256 (FIPS 180-4)
+ */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(sha256_ctx *ctx, const uint8_t *p) {
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) |
+               ((uint32_t)p[i * 4 + 2] << 8) | (uint32_t)p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3];
+    e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+        uint32_t s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+    ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sha256_init(sha256_ctx *ctx) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
+
+void sha256_update(sha256_ctx *ctx, const void *data, size_t len) {
+    const uint8_t *p = data;
+    ctx->length += len;
+
+    // Top up a partial block first
+    if (ctx->buffered) {
+        size_t take = 64 - ctx->buffered;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(ctx->buffer + ctx->buffered, p, take);
+        ctx->buffered += take;
+        p += take;
+        len -= take;
+        if (ctx->buffered < 64) {
+            return;
+        }
+        sha256_block(ctx, ctx->buffer);
+        ctx->buffered = 0;
+    }
+
+    while (len >= 64) {
+        sha256_block(ctx, p);
+        p += 64;
+        len -= 64;
+    }
+
+    memcpy(ctx->buffer, p, len);
+    ctx->buffered = len;
+}
+
+void sha256_final(sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_LEN]) {
+    uint64_t bits = ctx->length * 8;
+    uint8_t pad[72];
+    size_t pad_len = (ctx->buffered < 56) ? 56 - ctx->buffered : 120 - ctx->buffered;
+
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    sha256_update(ctx, pad, pad_len + 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4]     = (uint8_t)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)(ctx->state[i]);
+    }
+}
+
+/*
+ * XXH64
+ */
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;  // Little-endian hosts only, like inotify itself
+}
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = ROTL64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+void xxh64_init(xxh64_state *st, uint64_t seed) {
+    st->seed = seed;
+    st->v[0] = seed + XXH_P1 + XXH_P2;
+    st->v[1] = seed + XXH_P2;
+    st->v[2] = seed;
+    st->v[3] = seed - XXH_P1;
+    st->length = 0;
+    st->buffered = 0;
+}
+
+void xxh64_update(xxh64_state *st, const void *data, size_t len) {
+    const uint8_t *p = data;
+    st->length += len;
+
+    if (st->buffered + len < 32) {
+        memcpy(st->buffer + st->buffered, p, len);
+        st->buffered += len;
+        return;
+    }
+
+    if (st->buffered) {
+        size_t take = 32 - st->buffered;
+        memcpy(st->buffer + st->buffered, p, take);
+        for (int i = 0; i < 4; i++) {
+            st->v[i] = xxh64_round(st->v[i], read64(st->buffer + i * 8));
+        }
+        p += take;
+        len -= take;
+        st->buffered = 0;
+    }
+
+    while (len >= 32) {
+        st->v[0] = xxh64_round(st->v[0], read64(p));
+        st->v[1] = xxh64_round(st->v[1], read64(p + 8));
+        st->v[2] = xxh64_round(st->v[2], read64(p + 16));
+        st->v[3] = xxh64_round(st->v[3], read64(p + 24));
+        p += 32;
+        len -= 32;
+    }
+
+    memcpy(st->buffer, p, len);
+    st->buffered = len;
+}
+
+uint64_t xxh64_digest(const xxh64_state *st) {
+    uint64_t h;
+    const uint8_t *p = st->buffer;
+    size_t len = st->buffered;
+
+    if (st->length >= 32) {
+        h = ROTL64(st->v[0], 1) + ROTL64(st->v[1], 7) +
+            ROTL64(st->v[2], 12) + ROTL64(st->v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = xxh64_merge(h, st->v[i]);
+        }
+    } else {
+        h = st->seed + XXH_P5;
+    }
+    h += st->length;
+
+    while (len >= 8) {
+        h ^= xxh64_round(0, read64(p));
+        h = ROTL64(h, 27) * XXH_P1 + XXH_P4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)read32(p) * XXH_P1;
+        h = ROTL64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= (*p) * XXH_P5;
+        h = ROTL64(h, 11) * XXH_P1;
+        p++;
+        len--;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    xxh64_state st;
+    xxh64_init(&st, seed);
+    xxh64_update(&st, data, len);
+    return xxh64_digest(&st);
+}
+
+/*
+ * Misc
+ */
+
+uint64_t fnv1a_str(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void hex_digest(const uint8_t *digest, size_t len, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2]     = hex[digest[i] >> 4];
+        out[i * 2 + 1] = hex[digest[i] & 0x0f];
+    }
+    out[len * 2] = '\0';
+}
@@ -0,0 +1,44 @@
+// hash_utils.h
+#ifndef HASH_UTILS_H
+#define HASH_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LEN 32
+
+// SHA-256 streaming state
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;            // Total bytes consumed
+    uint8_t buffer[64];
+    size_t buffered;
+} sha256_ctx;
+
+// XXH64 streaming state
+typedef struct {
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t length;            // Total bytes consumed
+    uint8_t buffer[32];
+    size_t buffered;
+} xxh64_state;
+
+// SHA-256 (cryptographic)
+void sha256_init(sha256_ctx *ctx);
+void sha256_update(sha256_ctx *ctx, const void *data, size_t len);
+void sha256_final(sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_LEN]);
+
+// XXH64 (fast, non-cryptographic)
+void xxh64_init(xxh64_state *st, uint64_t seed);
+void xxh64_update(xxh64_state *st, const void *data, size_t len);
+uint64_t xxh64_digest(const xxh64_state *st);
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+// FNV-1a over a NUL-terminated string (for hash table keys)
+uint64_t fnv1a_str(const char *s);
+
+// Format a digest as lowercase hex (out must hold 2*len+1 bytes)
+void hex_digest(const uint8_t *digest, size_t len, char *out);
+
+#endif // HASH_UTILS_H
@@ -0,0 +1,576 @@
+// integrity.c
+#include "integrity.h"
+#include "crawl_throttle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ftw.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define BASELINE_MAGIC      "FWIB"
+#define BASELINE_VERSION    1
+#define HASH_BUF_SIZE       (128 * 1024)
+#define MAX_HASH_THREADS    32
+#define INDEX_EMPTY         UINT32_MAX
+
+// One baseline entry (64 bytes, written to disk as-is)
+typedef struct {
+    uint32_t path_off;          // Offset of the path in the string pool
+    uint16_t path_len;          // Path length without the NUL
+    uint16_t valid;             // Hashed successfully?
+    uint64_t size;              // File size when hashed
+    int64_t mtime;              // Modification time when hashed
+    uint64_t fast_hash;         // XXH64 of the content
+    uint8_t sha256[SHA256_DIGEST_LEN];
+} integrity_record;
+
+// On-disk header
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t pool_size;
+} baseline_header;
+
+// Baseline state
+static integrity_record *records = NULL;
+static uint32_t record_count = 0;
+static uint32_t record_cap = 0;
+static char *pool = NULL;
+static uint32_t pool_size = 0;
+static uint32_t pool_cap = 0;
+static uint32_t *index_slots = NULL;    // Open addressing: record index or INDEX_EMPTY
+static uint32_t index_cap = 0;
+
+// Crawl state (nftw has no user pointer)
+static ino_t *crawl_inodes = NULL;      // Inode of each record added by the crawl
+static uint32_t crawl_first = 0;        // First record added by the crawl
+static uint32_t inode_cap = 0;
+static int crawl_recursive = 0;
+static integrity_filter crawl_filter = NULL;
+
+// Worker pool state
+static uint32_t next_record = 0;
+
+// Append a path to the string pool and return its offset
+static int pool_add(const char *path, size_t len, uint32_t *off) {
+    if (pool_size + len + 1 > pool_cap) {
+        uint32_t cap = pool_cap ? pool_cap * 2 : 64 * 1024;
+        while (cap < pool_size + len + 1) {
+            cap *= 2;
+        }
+        char *p = realloc(pool, cap);
+        if (!p) {
+            return -1;
+        }
+        pool = p;
+        pool_cap = cap;
+    }
+    memcpy(pool + pool_size, path, len + 1);
+    *off = pool_size;
+    pool_size += len + 1;
+    return 0;
+}
+
+// Add an unhashed record for path
+static int record_add(const char *path, ino_t ino) {
+    size_t len = strlen(path);
+    if (len >= PATH_MAX) {
+        return -1;
+    }
+
+    if (record_count == record_cap) {
+        uint32_t cap = record_cap ? record_cap * 2 : 1024;
+        integrity_record *r = realloc(records, cap * sizeof(*r));
+        if (!r) {
+            return -1;
+        }
+        records = r;
+        record_cap = cap;
+    }
+    if (record_count - crawl_first == inode_cap) {
+        uint32_t cap = inode_cap ? inode_cap * 2 : 1024;
+        ino_t *ino_list = realloc(crawl_inodes, cap * sizeof(*ino_list));
+        if (!ino_list) {
+            return -1;
+        }
+        crawl_inodes = ino_list;
+        inode_cap = cap;
+    }
+
+    integrity_record *rec = &records[record_count];
+    memset(rec, 0, sizeof(*rec));
+    if (pool_add(path, len, &rec->path_off) < 0) {
+        return -1;
+    }
+    rec->path_len = (uint16_t)len;
+    crawl_inodes[record_count - crawl_first] = ino;
+    record_count++;
+    return 0;
+}
+
+// Rebuild the path -> record hash index
+static int build_index() {
+    uint32_t cap = 16;
+    while (cap < record_count * 2) {
+        cap *= 2;
+    }
+
+    uint32_t *slots = malloc(cap * sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    memset(slots, 0xff, cap * sizeof(*slots));
+
+    for (uint32_t i = 0; i < record_count; i++) {
+        uint32_t slot = (uint32_t)fnv1a_str(pool + records[i].path_off) & (cap - 1);
+        while (slots[slot] != INDEX_EMPTY) {
+            slot = (slot + 1) & (cap - 1);
+        }
+        slots[slot] = i;
+    }
+
+    free(index_slots);
+    index_slots = slots;
+    index_cap = cap;
+    return 0;
+}
+
+// Find the record for path
+static integrity_record *lookup(const char *path) {
+    if (!index_cap) {
+        return NULL;
+    }
+
+    uint32_t slot = (uint32_t)fnv1a_str(path) & (index_cap - 1);
+    while (index_slots[slot] != INDEX_EMPTY) {
+        integrity_record *rec = &records[index_slots[slot]];
+        if (strcmp(pool + rec->path_off, path) == 0) {
+            return rec;
+        }
+        slot = (slot + 1) & (index_cap - 1);
+    }
+    return NULL;
+}
+
+// Hash a file's content. sha may be NULL to compute only the fast hash.
+static int hash_file(const char *path, char *buf, size_t buf_len, int drop_cache,
+                     uint64_t *size, int64_t *mtime, uint64_t *fast, uint8_t *sha) {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    xxh64_state xs;
+    sha256_ctx sc;
+    xxh64_init(&xs, 0);
+    if (sha) {
+        sha256_init(&sc);
+    }
+
+    ssize_t n;
+    while ((n = read(fd, buf, buf_len)) > 0) {
+        xxh64_update(&xs, buf, (size_t)n);
+        if (sha) {
+            sha256_update(&sc, buf, (size_t)n);
+        }
+    }
+
+    // Don't let a full-tree crawl evict the working set of the watched applications
+    if (drop_cache) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+
+    if (n < 0) {
+        return -1;
+    }
+
+    *fast = xxh64_digest(&xs);
+    if (sha) {
+        sha256_final(&sc, sha);
+    }
+    return 0;
+}
+
+// Worker thread: claim records until none are left
+static void *hash_worker(void *arg) {
+    (void)arg;
+    char *buf = malloc(HASH_BUF_SIZE);
+    if (!buf) {
+        return NULL;
+    }
+
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&next_record, 1, __ATOMIC_RELAXED);
+        if (i >= record_count) {
+            break;
+        }
+        integrity_record *rec = &records[i];
+        if (hash_file(pool + rec->path_off, buf, HASH_BUF_SIZE, 1,
+                      &rec->size, &rec->mtime, &rec->fast_hash, rec->sha256) == 0) {
+            rec->valid = 1;
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// Is the device backing path a rotational disk?
+static int is_rotational(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return 0;
+    }
+
+    // Whole disks expose queue/ directly, partitions through their parent
+    static const char *formats[] = {
+        "/sys/dev/block/%u:%u/queue/rotational",
+        "/sys/dev/block/%u:%u/../queue/rotational"
+    };
+    for (int i = 0; i < 2; i++) {
+        char sys_path[128];
+        snprintf(sys_path, sizeof(sys_path), formats[i], major(st.st_dev), minor(st.st_dev));
+        FILE *fp = fopen(sys_path, "r");
+        if (fp) {
+            int rotational = fgetc(fp) == '1';
+            fclose(fp);
+            return rotational;
+        }
+    }
+    return 0;  // tmpfs, network filesystems, etc.
+}
+
+// Pick a worker count: seeks dominate on spinning disks, CPU on flash
+static int default_threads(const char *root) {
+    if (is_rotational(root)) {
+        return 2;
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    return cpus > 8 ? 8 : (int)cpus;
+}
+
+static int crawl_callback(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    if (typeflag == FTW_D && !crawl_recursive && ftwbuf->level > 0) {
+        return FTW_SKIP_SUBTREE;
+    }
+    if (typeflag == FTW_D) {
+        crawl_throttle();
+    }
+    if (typeflag != FTW_F || !S_ISREG(sb->st_mode)) {
+        return FTW_CONTINUE;
+    }
+    if (crawl_filter && !crawl_filter(path + ftwbuf->base)) {
+        return FTW_CONTINUE;
+    }
+    if (lookup(path)) {
+        return FTW_CONTINUE;  // Already in the baseline through another root
+    }
+    if (record_add(path, sb->st_ino) < 0) {
+        return FTW_STOP;
+    }
+    return FTW_CONTINUE;
+}
+
+typedef struct {
+    ino_t ino;
+    uint32_t idx;
+} inode_order;
+
+static int compare_inode(const void *a, const void *b) {
+    const inode_order *x = a, *y = b;
+    return (x->ino > y->ino) - (x->ino < y->ino);
+}
+
+// Sort the crawled records by inode so reads on rotational disks roughly
+// follow disk order
+static void sort_by_inode() {
+    uint32_t n = record_count - crawl_first;
+    integrity_record *crawled = records + crawl_first;
+    inode_order *order = malloc((n ? n : 1) * sizeof(*order));
+    integrity_record *sorted = malloc((n ? n : 1) * sizeof(*sorted));
+    if (!order || !sorted) {
+        free(order);
+        free(sorted);
+        return;  // Unsorted still works, just slower
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        order[i].ino = crawl_inodes[i];
+        order[i].idx = i;
+    }
+    qsort(order, n, sizeof(*order), compare_inode);
+
+    for (uint32_t i = 0; i < n; i++) {
+        sorted[i] = crawled[order[i].idx];
+    }
+    memcpy(crawled, sorted, n * sizeof(*sorted));
+    free(order);
+    free(sorted);
+}
+
+int integrity_build_baseline(const char *root, int recursive, int threads,
+                             integrity_filter filter) {
+    integrity_cleanup();
+    return integrity_add_tree(root, recursive, threads, filter);
+}
+
+int integrity_add_tree(const char *root, int recursive, int threads, integrity_filter filter) {
+    crawl_recursive = recursive;
+    crawl_filter = filter;
+    crawl_first = record_count;
+    int crawled = nftw(root, crawl_callback, 16, FTW_PHYS | FTW_ACTIONRETVAL) == 0;
+    if (crawled && is_rotational(root)) {
+        sort_by_inode();
+    }
+    free(crawl_inodes);
+    crawl_inodes = NULL;
+    inode_cap = 0;
+    if (!crawled) {
+        record_count = crawl_first;  // Their paths stay in the pool until it is compacted
+        return -1;
+    }
+
+    if (threads <= 0) {
+        threads = default_threads(root);
+    }
+    if (threads > MAX_HASH_THREADS) {
+        threads = MAX_HASH_THREADS;
+    }
+
+    pthread_t workers[MAX_HASH_THREADS];
+    int started = 0;
+    next_record = crawl_first;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, hash_worker, NULL) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        hash_worker(NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Drop files that vanished or could not be read during the crawl
+    uint32_t kept = crawl_first;
+    for (uint32_t i = crawl_first; i < record_count; i++) {
+        if (records[i].valid) {
+            records[kept++] = records[i];
+        }
+    }
+    record_count = kept;
+
+    if (build_index() < 0) {
+        return -1;
+    }
+    return (int)(record_count - crawl_first);
+}
+
+// Rewrite the pool so it only holds the paths of live records
+static int compact_pool() {
+    char *compact = malloc(pool_size ? pool_size : 1);
+    if (!compact) {
+        return -1;
+    }
+    uint32_t off = 0;
+    for (uint32_t i = 0; i < record_count; i++) {
+        memcpy(compact + off, pool + records[i].path_off, records[i].path_len + 1);
+        records[i].path_off = off;
+        off += records[i].path_len + 1;
+    }
+    free(pool);
+    pool = compact;
+    pool_size = off;
+    pool_cap = off ? off : 1;
+    return 0;
+}
+
+void integrity_remove_tree(const char *root) {
+    size_t len = strlen(root);
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < record_count; i++) {
+        const char *path = pool + records[i].path_off;
+        if (strncmp(path, root, len) != 0 || (path[len] != '\0' && path[len] != '/')) {
+            records[kept++] = records[i];
+        }
+    }
+    if (kept == record_count) {
+        return;
+    }
+    record_count = kept;
+
+    // Both only fail for lack of memory; a stale index would point past the end
+    compact_pool();
+    if (build_index() < 0) {
+        free(index_slots);
+        index_slots = NULL;
+        index_cap = 0;
+    }
+}
+
+int integrity_save_baseline(const char *file) {
+    // Compact the pool so the file only holds live paths
+    if (compact_pool() < 0) {
+        return -1;
+    }
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        return -1;
+    }
+
+    baseline_header hdr;
+    memcpy(hdr.magic, BASELINE_MAGIC, 4);
+    hdr.version = BASELINE_VERSION;
+    hdr.count = record_count;
+    hdr.pool_size = pool_size;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+             fwrite(records, sizeof(*records), record_count, fp) == record_count &&
+             fwrite(pool, 1, pool_size, fp) == pool_size;
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, file) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int integrity_load_baseline(const char *file) {
+    FILE *fp = fopen(file, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    baseline_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, BASELINE_MAGIC, 4) != 0 ||
+        hdr.version != BASELINE_VERSION) {
+        fclose(fp);
+        errno = EINVAL;
+        return -1;
+    }
+
+    integrity_cleanup();
+    records = malloc((hdr.count ? hdr.count : 1) * sizeof(*records));
+    pool = malloc(hdr.pool_size ? hdr.pool_size : 1);
+    if (!records || !pool ||
+        fread(records, sizeof(*records), hdr.count, fp) != hdr.count ||
+        fread(pool, 1, hdr.pool_size, fp) != hdr.pool_size) {
+        fclose(fp);
+        integrity_cleanup();
+        errno = EINVAL;
+        return -1;
+    }
+    fclose(fp);
+
+    record_count = record_cap = hdr.count;
+    pool_size = pool_cap = hdr.pool_size;
+
+    // Reject records pointing outside the pool
+    for (uint32_t i = 0; i < record_count; i++) {
+        if ((uint64_t)records[i].path_off + records[i].path_len >= pool_size ||
+            pool[records[i].path_off + records[i].path_len] != '\0') {
+            integrity_cleanup();
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (build_index() < 0) {
+        integrity_cleanup();
+        return -1;
+    }
+    return (int)record_count;
+}
+
+integrity_status integrity_check(const char *path, int removed) {
+    integrity_record *rec = lookup(path);
+
+    if (removed) {
+        return rec ? INTEGRITY_REMOVED : INTEGRITY_UNCHANGED;
+    }
+
+    static char buf[HASH_BUF_SIZE];
+    uint64_t size, fast;
+    int64_t mtime;
+
+    if (!rec) {
+        struct stat st;
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+            return INTEGRITY_UNCHANGED;  // Gone again, or not a regular file
+        }
+        return INTEGRITY_ADDED;
+    }
+
+    // Cheap rejection first: a size change needs no read at all
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return errno == ENOENT ? INTEGRITY_REMOVED : INTEGRITY_ERROR;
+    }
+    if (S_ISREG(st.st_mode) && (uint64_t)st.st_size != rec->size) {
+        return INTEGRITY_MODIFIED;
+    }
+
+    // Same size: one read yields both hashes. The fast hash is not collision
+    // resistant, so a match is only trusted once SHA-256 agrees as well.
+    uint8_t sha[SHA256_DIGEST_LEN];
+    if (hash_file(path, buf, sizeof(buf), 0, &size, &mtime, &fast, sha) < 0) {
+        return errno == ENOENT ? INTEGRITY_REMOVED : INTEGRITY_ERROR;
+    }
+    if (size != rec->size || fast != rec->fast_hash ||
+        memcmp(sha, rec->sha256, SHA256_DIGEST_LEN) != 0) {
+        return INTEGRITY_MODIFIED;
+    }
+    return INTEGRITY_UNCHANGED;
+}
+
+const char *integrity_status_name(integrity_status status) {
+    switch (status) {
+        case INTEGRITY_UNCHANGED: return "unchanged";
+        case INTEGRITY_MODIFIED:  return "modified";
+        case INTEGRITY_ADDED:     return "added";
+        case INTEGRITY_REMOVED:   return "removed";
+        default:                  return "unreadable";
+    }
+}
+
+void integrity_cleanup() {
+    free(records);
+    free(pool);
+    free(index_slots);
+    records = NULL;
+    pool = NULL;
+    index_slots = NULL;
+    record_count = record_cap = 0;
+    pool_size = pool_cap = 0;
+    index_cap = 0;
+}
@@ -0,0 +1,46 @@
+// integrity.h
+#ifndef INTEGRITY_H
+#define INTEGRITY_H
+
+#include <stdint.h>
+#include "hash_utils.h"
+
+// Result of comparing a file against the baseline
+typedef enum {
+    INTEGRITY_UNCHANGED = 0,    // Content matches the baseline (or untracked and gone)
+    INTEGRITY_MODIFIED,         // Content differs from the baseline
+    INTEGRITY_ADDED,            // File is not part of the baseline
+    INTEGRITY_REMOVED,          // Baseline file no longer exists
+    INTEGRITY_ERROR             // File could not be read
+} integrity_status;
+
+// Filename filter applied while building the baseline (1 = include)
+typedef int (*integrity_filter)(const char *filename);
+
+// Hash every regular file under root with a pool of worker threads.
+// threads <= 0 picks a count based on the backing device.
+// Returns the number of files in the baseline, or -1 on error.
+int integrity_build_baseline(const char *root, int recursive, int threads,
+                             integrity_filter filter);
+
+// Hash another tree into the baseline as it is now (a root added at
+// runtime). Returns the number of files added, or -1 on error.
+int integrity_add_tree(const char *root, int recursive, int threads, integrity_filter filter);
+
+// Drop the baseline of root and everything below it
+void integrity_remove_tree(const char *root);
+
+// Save/load the baseline in its compact binary form
+int integrity_save_baseline(const char *file);
+int integrity_load_baseline(const char *file);
+
+// Re-hash a file (or account for its removal) and compare with the baseline
+integrity_status integrity_check(const char *path, int removed);
+
+// Human readable name for a status
+const char *integrity_status_name(integrity_status status);
+
+// Release the baseline
+void integrity_cleanup();
+
+#endif // INTEGRITY_H
@@ -0,0 +1,109 @@
+// intern.c
+#include "intern.h"
+#include "path_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define CHUNK_BITS  16
+#define CHUNK_SIZE  (1u << CHUNK_BITS)
+#define MAX_CHUNKS  (1u << 16)
+
+// Strings live in fixed-size chunks that never move, so a pointer handed
+// out by intern_string() survives any later growth
+static char **chunks[MAX_CHUNKS];
+static uint32_t string_count = 0;
+static path_map ids;
+static int ids_ready = 0;
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static uint32_t find_locked(const char *s) {
+    uint32_t id;
+    return ids_ready && path_map_get(&ids, s, &id) ? id : INTERN_NONE;
+}
+
+uint32_t intern(const char *s) {
+    pthread_rwlock_rdlock(&lock);
+    uint32_t id = find_locked(s);
+    pthread_rwlock_unlock(&lock);
+    if (id != INTERN_NONE) {
+        return id;
+    }
+
+    pthread_rwlock_wrlock(&lock);
+    id = find_locked(s);  // Another thread may have added it meanwhile
+    if (id != INTERN_NONE) {
+        pthread_rwlock_unlock(&lock);
+        return id;
+    }
+
+    if (!ids_ready) {
+        if (path_map_init(&ids, 1024) < 0) {
+            pthread_rwlock_unlock(&lock);
+            return INTERN_NONE;
+        }
+        ids_ready = 1;
+    }
+
+    uint32_t chunk = string_count >> CHUNK_BITS;
+    if (chunk >= MAX_CHUNKS) {
+        pthread_rwlock_unlock(&lock);
+        return INTERN_NONE;
+    }
+    if (!chunks[chunk]) {
+        chunks[chunk] = calloc(CHUNK_SIZE, sizeof(char *));
+    }
+    char *copy = strdup(s);
+    if (!chunks[chunk] || !copy || path_map_put(&ids, s, string_count) < 0) {
+        free(copy);
+        pthread_rwlock_unlock(&lock);
+        return INTERN_NONE;
+    }
+
+    id = string_count++;
+    chunks[chunk][id & (CHUNK_SIZE - 1)] = copy;
+    pthread_rwlock_unlock(&lock);
+    return id;
+}
+
+uint32_t intern_find(const char *s) {
+    pthread_rwlock_rdlock(&lock);
+    uint32_t id = find_locked(s);
+    pthread_rwlock_unlock(&lock);
+    return id;
+}
+
+const char *intern_string(uint32_t id) {
+    const char *s = NULL;
+
+    pthread_rwlock_rdlock(&lock);
+    if (id < string_count) {
+        s = chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)];
+    }
+    pthread_rwlock_unlock(&lock);
+    return s;
+}
+
+uint32_t intern_count() {
+    pthread_rwlock_rdlock(&lock);
+    uint32_t n = string_count;
+    pthread_rwlock_unlock(&lock);
+    return n;
+}
+
+void intern_cleanup() {
+    pthread_rwlock_wrlock(&lock);
+    for (uint32_t c = 0; c < MAX_CHUNKS && chunks[c]; c++) {
+        for (uint32_t i = 0; i < CHUNK_SIZE; i++) {
+            free(chunks[c][i]);
+        }
+        free(chunks[c]);
+        chunks[c] = NULL;
+    }
+    if (ids_ready) {
+        path_map_free(&ids);
+        ids_ready = 0;
+    }
+    string_count = 0;
+    pthread_rwlock_unlock(&lock);
+}
@@ -0,0 +1,26 @@
+// intern.h
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+#define INTERN_NONE UINT32_MAX
+
+// Return the id of s, adding it on first sight. Ids are dense, start at 0
+// and stay valid (never reused) until intern_cleanup(). INTERN_NONE on
+// allocation failure. Safe to call from any thread.
+uint32_t intern(const char *s);
+
+// Id of s if it was interned before, INTERN_NONE otherwise
+uint32_t intern_find(const char *s);
+
+// The string for an id, or NULL. The pointer stays valid until cleanup.
+const char *intern_string(uint32_t id);
+
+// Number of strings interned so far
+uint32_t intern_count();
+
+// Drop the table (invalidates all ids)
+void intern_cleanup();
+
+#endif // INTERN_H
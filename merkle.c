@@ -0,0 +1,553 @@
+// merkle.c
+#include "merkle.h"
+#include "hash_utils.h"
+#include "path_map.h"
+#include "tree_walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MERKLE_MAGIC    "FWMK"
+#define MERKLE_VERSION  1
+#define NO_NODE         UINT32_MAX
+#define DIR_SEED        0x6469726563746f72ULL
+
+// In-memory node. A directory's hash is derived from the sum of its
+// children's contributions; addition is order independent, so replacing
+// one child is a subtract and an add instead of a rehash of the listing.
+typedef struct {
+    char *path;                 // Full path (key in node_ids), NULL when free
+    uint64_t hash;              // File: metadata digest; directory: children digest
+    uint64_t contrib;           // hash(name, hash), as added to the parent's sum
+    uint64_t child_sum;
+    uint32_t child_count;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;      // Also links the free list
+    uint32_t prev_sibling;
+    int is_dir;
+} merkle_node;
+
+// On-disk snapshot
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t pool_size;
+    uint64_t root_hash;
+} snapshot_header;
+
+struct merkle_record {
+    uint64_t hash;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t name_off;          // Basename in the pool ("" for the root)
+    uint32_t is_dir;
+    uint32_t reserved;
+};
+
+static merkle_node *nodes = NULL;
+static uint32_t node_count = 0;
+static uint32_t node_cap = 0;
+static uint32_t free_nodes = NO_NODE;
+static uint32_t root_node = NO_NODE;
+static path_map node_ids;
+static int skip_git_dirs = 0;
+static int tree_dirty = 0;
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Collapse repeated slashes and drop a trailing one so event paths built
+// from "dir/" + "/" + name match the keys created by the crawl
+static void normalize_path(char *dst, const char *src, size_t size) {
+    size_t n = 0;
+    for (; *src && n + 1 < size; src++) {
+        if (*src == '/' && n > 0 && dst[n - 1] == '/') {
+            continue;
+        }
+        dst[n++] = *src;
+    }
+    while (n > 1 && dst[n - 1] == '/') {
+        n--;
+    }
+    dst[n] = '\0';
+}
+
+static uint64_t file_digest(const struct stat *st) {
+    uint64_t fields[4] = {
+        (uint64_t)st->st_mode,
+        (uint64_t)st->st_size,
+        (uint64_t)st->st_mtim.tv_sec,
+        (uint64_t)st->st_mtim.tv_nsec
+    };
+    return xxh64(fields, sizeof(fields), 0);
+}
+
+static uint64_t dir_digest(const merkle_node *n) {
+    uint64_t fields[2] = { n->child_sum, n->child_count };
+    return xxh64(fields, sizeof(fields), DIR_SEED);
+}
+
+static uint64_t contribution(const merkle_node *n) {
+    const char *name = base_name(n->path);
+    return xxh64(name, strlen(name), n->hash);
+}
+
+static uint32_t node_alloc(const char *path) {
+    uint32_t idx;
+
+    if (free_nodes != NO_NODE) {
+        idx = free_nodes;
+        free_nodes = nodes[idx].next_sibling;
+    } else {
+        if (node_count == node_cap) {
+            uint32_t cap = node_cap ? node_cap * 2 : 1024;
+            merkle_node *grown = realloc(nodes, cap * sizeof(*nodes));
+            if (!grown) {
+                return NO_NODE;
+            }
+            nodes = grown;
+            node_cap = cap;
+        }
+        idx = node_count++;
+    }
+
+    memset(&nodes[idx], 0, sizeof(nodes[idx]));
+    nodes[idx].path = strdup(path);
+    if (!nodes[idx].path || path_map_put(&node_ids, path, idx) < 0) {
+        free(nodes[idx].path);
+        nodes[idx].path = NULL;
+        nodes[idx].next_sibling = free_nodes;
+        free_nodes = idx;
+        return NO_NODE;
+    }
+    nodes[idx].parent = nodes[idx].first_child = NO_NODE;
+    nodes[idx].next_sibling = nodes[idx].prev_sibling = NO_NODE;
+    return idx;
+}
+
+// Hook a finished node into its parent's child list and sum
+static void link_child(uint32_t parent, uint32_t idx) {
+    merkle_node *p = &nodes[parent];
+    merkle_node *n = &nodes[idx];
+
+    n->parent = parent;
+    n->contrib = contribution(n);
+    n->next_sibling = p->first_child;
+    if (p->first_child != NO_NODE) {
+        nodes[p->first_child].prev_sibling = idx;
+    }
+    p->first_child = idx;
+    p->child_sum += n->contrib;
+    p->child_count++;
+}
+
+static void unlink_child(uint32_t idx) {
+    merkle_node *n = &nodes[idx];
+    merkle_node *p = &nodes[n->parent];
+
+    if (n->prev_sibling != NO_NODE) {
+        nodes[n->prev_sibling].next_sibling = n->next_sibling;
+    } else {
+        p->first_child = n->next_sibling;
+    }
+    if (n->next_sibling != NO_NODE) {
+        nodes[n->next_sibling].prev_sibling = n->prev_sibling;
+    }
+    p->child_sum -= n->contrib;
+    p->child_count--;
+}
+
+// Free a node and everything below it (links to it are the caller's job)
+static void free_subtree(uint32_t idx) {
+    uint32_t child = nodes[idx].first_child;
+    while (child != NO_NODE) {
+        uint32_t next = nodes[child].next_sibling;
+        free_subtree(child);
+        child = next;
+    }
+
+    path_map_remove(&node_ids, nodes[idx].path);
+    free(nodes[idx].path);
+    nodes[idx].path = NULL;
+    nodes[idx].next_sibling = free_nodes;
+    free_nodes = idx;
+}
+
+// Walk callbacks for scan(): nodes are created on the way down and hashed
+// and linked on the way up, once all their children are in
+static uint32_t enter_node(const char *path, const struct stat *st, uint32_t parent) {
+    (void)parent;
+    if (skip_git_dirs && S_ISDIR(st->st_mode) && strcmp(base_name(path), ".git") == 0) {
+        return NO_NODE;
+    }
+
+    uint32_t idx = node_alloc(path);
+    if (idx == NO_NODE) {
+        return NO_NODE;
+    }
+    nodes[idx].is_dir = S_ISDIR(st->st_mode);
+    if (!nodes[idx].is_dir) {
+        nodes[idx].hash = file_digest(st);
+    }
+    return idx;
+}
+
+static void leave_node(uint32_t idx, uint32_t parent) {
+    if (nodes[idx].is_dir) {
+        nodes[idx].hash = dir_digest(&nodes[idx]);
+    }
+    if (parent != NO_NODE) {
+        link_child(parent, idx);
+    }
+}
+
+// Hash path (and everything below a directory) and attach it below parent.
+// Returns the new node, or NO_NODE if the path is gone or excluded.
+static uint32_t scan(const char *path, uint32_t parent) {
+    uint32_t idx = tree_walk(path, enter_node, leave_node);
+    if (idx != NO_NODE && parent != NO_NODE) {
+        link_child(parent, idx);
+    }
+    return idx;
+}
+
+// Recompute directory hashes from idx up to the root
+static void propagate(uint32_t idx) {
+    while (idx != NO_NODE) {
+        merkle_node *n = &nodes[idx];
+        n->hash = dir_digest(n);
+        if (n->parent == NO_NODE) {
+            break;
+        }
+
+        uint64_t contrib = contribution(n);
+        nodes[n->parent].child_sum += contrib - n->contrib;
+        n->contrib = contrib;
+        idx = n->parent;
+    }
+}
+
+int merkle_build(const char *root, int skip_git) {
+    char path[PATH_MAX];
+
+    merkle_cleanup();
+    if (path_map_init(&node_ids, 1024) < 0) {
+        return -1;
+    }
+    skip_git_dirs = skip_git;
+
+    normalize_path(path, root, sizeof(path));
+    root_node = scan(path, NO_NODE);
+    if (root_node == NO_NODE) {
+        return -1;
+    }
+    tree_dirty = 1;
+    return (int)node_count;
+}
+
+void merkle_update(const char *path) {
+    char norm[PATH_MAX];
+    char dir[PATH_MAX];
+    uint32_t idx, parent;
+
+    if (root_node == NO_NODE) {
+        return;
+    }
+
+    normalize_path(norm, path, sizeof(norm));
+    const char *slash = strrchr(norm, '/');
+    if (!slash || slash == norm) {
+        return;
+    }
+    memcpy(dir, norm, (size_t)(slash - norm));
+    dir[slash - norm] = '\0';
+    if (!path_map_get(&node_ids, dir, &parent) || !nodes[parent].is_dir) {
+        return;  // Outside the tree (or below an excluded directory)
+    }
+
+    struct stat st;
+    int exists = lstat(norm, &st) == 0;
+    int known = path_map_get(&node_ids, norm, &idx);
+
+    // A directory that is still a directory is kept current by its children
+    if (known && exists && nodes[idx].is_dir && S_ISDIR(st.st_mode)) {
+        return;
+    }
+
+    if (known) {
+        unlink_child(idx);
+        free_subtree(idx);
+    }
+    if (exists) {
+        scan(norm, parent);
+    }
+    propagate(parent);
+    tree_dirty = 1;
+}
+
+uint64_t merkle_root_hash() {
+    return root_node != NO_NODE ? nodes[root_node].hash : 0;
+}
+
+int merkle_dirty() {
+    return tree_dirty;
+}
+
+// Number the subtree in pre-order
+static void preorder(uint32_t idx, uint32_t *order, uint32_t *remap, uint32_t *pos) {
+    remap[idx] = *pos;
+    order[(*pos)++] = idx;
+    for (uint32_t c = nodes[idx].first_child; c != NO_NODE; c = nodes[c].next_sibling) {
+        preorder(c, order, remap, pos);
+    }
+}
+
+int merkle_save(const char *file) {
+    if (root_node == NO_NODE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t *order = malloc(node_count * sizeof(*order));
+    uint32_t *remap = malloc(node_count * sizeof(*remap));
+    if (!order || !remap) {
+        free(order);
+        free(remap);
+        return -1;
+    }
+    uint32_t live = 0;
+    preorder(root_node, order, remap, &live);
+
+    uint64_t pool_bytes = 1;
+    for (uint32_t i = 1; i < live; i++) {
+        pool_bytes += strlen(base_name(nodes[order[i]].path)) + 1;
+    }
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp || pool_bytes > UINT32_MAX) {
+        if (fp) {
+            fclose(fp);
+        }
+        free(order);
+        free(remap);
+        return -1;
+    }
+
+    snapshot_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MERKLE_MAGIC, 4);
+    hdr.version = MERKLE_VERSION;
+    hdr.count = live;
+    hdr.pool_size = (uint32_t)pool_bytes;
+    hdr.root_hash = nodes[root_node].hash;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    uint32_t off = 1;  // Offset 0 is the root's empty name
+    for (uint32_t i = 0; ok && i < live; i++) {
+        const merkle_node *n = &nodes[order[i]];
+        struct merkle_record rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.hash = n->hash;
+        rec.parent = n->parent != NO_NODE ? remap[n->parent] : NO_NODE;
+        rec.first_child = n->first_child != NO_NODE ? remap[n->first_child] : NO_NODE;
+        rec.next_sibling = n->next_sibling != NO_NODE ? remap[n->next_sibling] : NO_NODE;
+        rec.name_off = i ? off : 0;
+        rec.is_dir = (uint32_t)n->is_dir;
+        if (i) {
+            off += (uint32_t)strlen(base_name(n->path)) + 1;
+        }
+        ok = fwrite(&rec, sizeof(rec), 1, fp) == 1;
+    }
+    ok = ok && fputc('\0', fp) != EOF;
+    for (uint32_t i = 1; ok && i < live; i++) {
+        const char *name = base_name(nodes[order[i]].path);
+        size_t len = strlen(name) + 1;
+        ok = fwrite(name, 1, len, fp) == len;
+    }
+
+    free(order);
+    free(remap);
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, file) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    tree_dirty = 0;
+    return 0;
+}
+
+void merkle_cleanup() {
+    for (uint32_t i = 0; i < node_count; i++) {
+        free(nodes[i].path);
+    }
+    free(nodes);
+    path_map_free(&node_ids);
+
+    nodes = NULL;
+    node_count = node_cap = 0;
+    free_nodes = root_node = NO_NODE;
+    tree_dirty = 0;
+}
+
+/*
+ * Reader side
+ */
+
+int merkle_view_open(merkle_view *view, const char *file) {
+    memset(view, 0, sizeof(*view));
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(snapshot_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const snapshot_header *hdr = map;
+    uint64_t need = sizeof(*hdr) + (uint64_t)hdr->count * sizeof(struct merkle_record) +
+                    hdr->pool_size;
+    if (memcmp(hdr->magic, MERKLE_MAGIC, 4) != 0 || hdr->version != MERKLE_VERSION ||
+        hdr->count == 0 || hdr->pool_size == 0 || need != (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    view->map = map;
+    view->map_len = (size_t)st.st_size;
+    view->records = (const struct merkle_record *)((const char *)map + sizeof(*hdr));
+    view->pool = (const char *)(view->records + hdr->count);
+    view->count = hdr->count;
+
+    // Records are in pre-order, so every link points forward; anything
+    // else (or a link past the end) would make the walk loop or overrun
+    for (uint32_t i = 0; i < view->count; i++) {
+        const struct merkle_record *r = &view->records[i];
+        if ((r->first_child != NO_NODE && (r->first_child <= i || r->first_child >= view->count)) ||
+            (r->next_sibling != NO_NODE && (r->next_sibling <= i || r->next_sibling >= view->count)) ||
+            r->name_off >= hdr->pool_size) {
+            merkle_view_close(view);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (view->pool[hdr->pool_size - 1] != '\0') {
+        merkle_view_close(view);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void merkle_view_close(merkle_view *view) {
+    if (view->map) {
+        munmap(view->map, view->map_len);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+static const char *record_name(const merkle_view *v, uint32_t i) {
+    return v->pool + v->records[i].name_off;
+}
+
+// Compare the children of directory ia (in a) and ib (in b)
+static uint32_t diff_dirs(const merkle_view *a, uint32_t ia, const merkle_view *b, uint32_t ib,
+                          char *path, size_t path_len, merkle_diff_cb cb, void *arg) {
+    path_map names;
+    uint32_t found = 0;
+
+    if (path_map_init(&names, 64) < 0) {
+        return 0;
+    }
+    for (uint32_t c = b->records[ib].first_child; c != NO_NODE; c = b->records[c].next_sibling) {
+        path_map_put(&names, record_name(b, c), c);
+    }
+
+    for (uint32_t c = a->records[ia].first_child; c != NO_NODE; c = a->records[c].next_sibling) {
+        const char *name = record_name(a, c);
+        int n = snprintf(path + path_len, PATH_MAX - path_len, "%s%s", path_len ? "/" : "", name);
+        if (n < 0 || (size_t)n >= PATH_MAX - path_len) {
+            continue;
+        }
+
+        uint32_t other;
+        if (!path_map_get(&names, name, &other)) {
+            cb(path, MERKLE_ONLY_A, arg);
+            found++;
+            continue;
+        }
+        path_map_remove(&names, name);
+
+        const struct merkle_record *ra = &a->records[c];
+        const struct merkle_record *rb = &b->records[other];
+        if (ra->hash == rb->hash && ra->is_dir == rb->is_dir) {
+            continue;
+        }
+        if (ra->is_dir && rb->is_dir) {
+            found += diff_dirs(a, c, b, other, path, path_len + (size_t)n, cb, arg);
+        } else {
+            cb(path, MERKLE_DIFFERS, arg);
+            found++;
+        }
+    }
+
+    // Whatever is left in the map was not matched by a
+    for (uint32_t c = b->records[ib].first_child; c != NO_NODE; c = b->records[c].next_sibling) {
+        const char *name = record_name(b, c);
+        uint32_t unused;
+        if (path_map_get(&names, name, &unused)) {
+            snprintf(path + path_len, PATH_MAX - path_len, "%s%s", path_len ? "/" : "", name);
+            cb(path, MERKLE_ONLY_B, arg);
+            found++;
+        }
+    }
+
+    path_map_free(&names);
+    path[path_len] = '\0';
+    return found;
+}
+
+int merkle_view_equal(const merkle_view *a, const merkle_view *b) {
+    return a->records[0].hash == b->records[0].hash &&
+           a->records[0].is_dir == b->records[0].is_dir;
+}
+
+uint32_t merkle_diff(const merkle_view *a, const merkle_view *b, merkle_diff_cb cb, void *arg) {
+    char path[PATH_MAX] = "";
+
+    if (merkle_view_equal(a, b)) {
+        return 0;
+    }
+    if (!a->records[0].is_dir || !b->records[0].is_dir) {
+        cb(".", MERKLE_DIFFERS, arg);
+        return 1;
+    }
+    return diff_dirs(a, 0, b, 0, path, 0, cb, arg);
+}
@@ -0,0 +1,68 @@
+// merkle.h
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only view of a saved tree snapshot (mmap'd)
+typedef struct {
+    void *map;
+    size_t map_len;
+    const struct merkle_record *records;   // Pre-order; record 0 is the root
+    const char *pool;
+    uint32_t count;
+} merkle_view;
+
+// How a path differs between two snapshots
+typedef enum {
+    MERKLE_ONLY_A = 0,          // Present only in the first snapshot
+    MERKLE_ONLY_B,              // Present only in the second snapshot
+    MERKLE_DIFFERS              // Present in both with different content
+} merkle_diff_kind;
+
+// Called once per difference with the path relative to the root
+typedef void (*merkle_diff_cb)(const char *path, merkle_diff_kind kind, void *arg);
+
+/*
+ * Writer side (fswatcher)
+ */
+
+// Hash everything under root. Files hash their type, size and mtime;
+// a directory hashes the names and hashes of its children, so equal
+// root hashes mean equal trees. skip_git leaves .git directories out.
+// Returns the number of nodes, or -1 on error.
+int merkle_build(const char *root, int skip_git);
+
+// Re-read one path after an event (re-hash it, drop it, or scan a new
+// directory) and update the hashes on the way up to the root
+void merkle_update(const char *path);
+
+// Current root hash
+uint64_t merkle_root_hash();
+
+// Has the tree changed since the last save?
+int merkle_dirty();
+
+// Write a snapshot atomically to file
+int merkle_save(const char *file);
+
+// Release the tree
+void merkle_cleanup();
+
+/*
+ * Reader side (fsdiff)
+ */
+
+// Map a saved snapshot read-only
+int merkle_view_open(merkle_view *view, const char *file);
+void merkle_view_close(merkle_view *view);
+
+// Do two snapshots describe identical trees? (compares the root hashes)
+int merkle_view_equal(const merkle_view *a, const merkle_view *b);
+
+// Compare two snapshots top-down, descending only into directories whose
+// hashes differ. Returns the number of differences reported.
+uint32_t merkle_diff(const merkle_view *a, const merkle_view *b, merkle_diff_cb cb, void *arg);
+
+#endif // MERKLE_H
@@ -0,0 +1,165 @@
+// path_map.c
+#include "path_map.h"
+#include "hash_utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+static char tombstone_marker;
+#define PATH_MAP_TOMBSTONE (&tombstone_marker)
+
+// Find the slot holding key, or the slot where it should be inserted
+static uint32_t find_slot(const path_map *m, const char *key, int *found) {
+    uint32_t mask = m->cap - 1;
+    uint32_t slot = (uint32_t)fnv1a_str(key) & mask;
+    uint32_t insert_at = UINT32_MAX;
+
+    while (m->keys[slot]) {
+        if (m->keys[slot] == PATH_MAP_TOMBSTONE) {
+            if (insert_at == UINT32_MAX) {
+                insert_at = slot;
+            }
+        } else if (strcmp(m->keys[slot], key) == 0) {
+            *found = 1;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    *found = 0;
+    return insert_at != UINT32_MAX ? insert_at : slot;
+}
+
+// Grow (or just clear out tombstones) to new_cap slots
+static int rehash(path_map *m, uint32_t new_cap) {
+    path_map grown;
+    if (path_map_init(&grown, new_cap) < 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < m->cap; i++) {
+        char *key = m->keys[i];
+        if (key && key != PATH_MAP_TOMBSTONE) {
+            int found;
+            uint32_t slot = find_slot(&grown, key, &found);
+            grown.keys[slot] = key;  // Keys move, no copy
+            grown.values[slot] = m->values[i];
+            grown.count++;
+            grown.used++;
+        }
+    }
+
+    free(m->keys);
+    free(m->values);
+    *m = grown;
+    return 0;
+}
+
+int path_map_init(path_map *m, uint32_t initial_cap) {
+    uint32_t cap = 16;
+    while (cap < initial_cap) {
+        cap *= 2;
+    }
+
+    m->keys = calloc(cap, sizeof(*m->keys));
+    m->values = malloc(cap * sizeof(*m->values));
+    if (!m->keys || !m->values) {
+        free(m->keys);
+        free(m->values);
+        return -1;
+    }
+    m->cap = cap;
+    m->count = 0;
+    m->used = 0;
+    return 0;
+}
+
+int path_map_put(path_map *m, const char *key, uint32_t value) {
+    // Keep the load factor (tombstones included) under 3/4
+    if ((m->used + 1) * 4 > m->cap * 3) {
+        uint32_t new_cap = (m->count + 1) * 2 > m->cap ? m->cap * 2 : m->cap;
+        if (rehash(m, new_cap) < 0) {
+            return -1;
+        }
+    }
+
+    int found;
+    uint32_t slot = find_slot(m, key, &found);
+    if (!found) {
+        char *copy = strdup(key);
+        if (!copy) {
+            return -1;
+        }
+        if (!m->keys[slot]) {
+            m->used++;
+        }
+        m->keys[slot] = copy;
+        m->count++;
+    }
+    m->values[slot] = value;
+    return 0;
+}
+
+int path_map_get(const path_map *m, const char *key, uint32_t *value) {
+    if (!m->cap) {
+        return 0;
+    }
+
+    int found;
+    uint32_t slot = find_slot(m, key, &found);
+    if (found && value) {
+        *value = m->values[slot];
+    }
+    return found;
+}
+
+int path_map_remove(path_map *m, const char *key) {
+    if (!m->cap) {
+        return 0;
+    }
+
+    int found;
+    uint32_t slot = find_slot(m, key, &found);
+    if (!found) {
+        return 0;
+    }
+    free(m->keys[slot]);
+    m->keys[slot] = PATH_MAP_TOMBSTONE;
+    m->count--;
+    return 1;
+}
+
+uint32_t path_map_remove_tree(path_map *m, const char *dir,
+                              void (*release)(uint32_t value, void *arg), void *arg) {
+    size_t len = strlen(dir);
+    int slash = len > 0 && dir[len - 1] == '/';  // "/" already ends in the separator
+    uint32_t removed = 0;
+
+    for (uint32_t i = 0; i < m->cap && m->count; i++) {
+        char *key = m->keys[i];
+        if (!key || key == PATH_MAP_TOMBSTONE || strncmp(key, dir, len) != 0 ||
+            (!slash && key[len] != '\0' && key[len] != '/')) {
+            continue;
+        }
+        if (release) {
+            release(m->values[i], arg);
+        }
+        free(key);
+        m->keys[i] = PATH_MAP_TOMBSTONE;
+        m->count--;
+        removed++;
+    }
+    return removed;
+}
+
+void path_map_free(path_map *m) {
+    for (uint32_t i = 0; i < m->cap; i++) {
+        if (m->keys[i] && m->keys[i] != PATH_MAP_TOMBSTONE) {
+            free(m->keys[i]);
+        }
+    }
+    free(m->keys);
+    free(m->values);
+    m->keys = NULL;
+    m->values = NULL;
+    m->cap = m->count = m->used = 0;
+}
@@ -0,0 +1,36 @@
+// path_map.h
+#ifndef PATH_MAP_H
+#define PATH_MAP_H
+
+#include <stdint.h>
+
+// Open-addressing hash map from path strings to 32-bit values
+typedef struct {
+    char **keys;            // NULL = empty slot, PATH_MAP_TOMBSTONE = removed
+    uint32_t *values;
+    uint32_t cap;           // Slot count (power of two)
+    uint32_t count;         // Live entries
+    uint32_t used;          // Live entries plus tombstones
+} path_map;
+
+// Initialize an empty map
+int path_map_init(path_map *m, uint32_t initial_cap);
+
+// Insert or replace key -> value (the key is copied)
+int path_map_put(path_map *m, const char *key, uint32_t value);
+
+// Look up key; returns 1 and stores the value if found, 0 otherwise
+int path_map_get(const path_map *m, const char *key, uint32_t *value);
+
+// Remove key; returns 1 if it was present
+int path_map_remove(path_map *m, const char *key);
+
+// Remove dir and every key below it (dir/...), passing each removed
+// value to release if given; returns the number removed. Visits every slot.
+uint32_t path_map_remove_tree(path_map *m, const char *dir,
+                              void (*release)(uint32_t value, void *arg), void *arg);
+
+// Release all memory
+void path_map_free(path_map *m);
+
+#endif // PATH_MAP_H
@@ -0,0 +1,160 @@
+// path_radix.c
+#include "path_radix.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+// Edges carry the label; children are few, so a sibling list will do
+struct radix_node {
+    char *label;
+    size_t label_len;
+    uint32_t bits;
+    struct radix_node *first_child;
+    struct radix_node *next_sibling;
+};
+
+// Collapse repeated slashes and end with exactly one, so keys compare
+// on component boundaries. Returns the length, or 0 if it does not fit.
+static size_t make_key(char *dst, const char *src) {
+    size_t n = 0;
+    for (; *src; src++) {
+        if (*src == '/' && n > 0 && dst[n - 1] == '/') {
+            continue;
+        }
+        if (n + 2 >= PATH_MAX) {
+            return 0;
+        }
+        dst[n++] = *src;
+    }
+    if (n == 0 || dst[n - 1] != '/') {
+        dst[n++] = '/';
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+static struct radix_node *node_new(const char *label, size_t len, uint32_t bits) {
+    struct radix_node *n = calloc(1, sizeof(*n));
+    if (!n) {
+        return NULL;
+    }
+    n->label = malloc(len + 1);
+    if (!n->label) {
+        free(n);
+        return NULL;
+    }
+    memcpy(n->label, label, len);
+    n->label[len] = '\0';
+    n->label_len = len;
+    n->bits = bits;
+    return n;
+}
+
+static struct radix_node *child_for(const struct radix_node *n, char c) {
+    struct radix_node *child = n->first_child;
+    while (child && child->label[0] != c) {
+        child = child->next_sibling;
+    }
+    return child;
+}
+
+int path_radix_init(path_radix *t) {
+    t->prefixes = 0;
+    t->root = node_new("", 0, 0);
+    return t->root ? 0 : -1;
+}
+
+int path_radix_insert(path_radix *t, const char *prefix, uint32_t bits) {
+    char key[PATH_MAX];
+    size_t len = make_key(key, prefix);
+    if (len == 0) {
+        return -1;
+    }
+
+    struct radix_node *node = t->root;
+    const char *p = key;
+    while (*p) {
+        struct radix_node *child = child_for(node, *p);
+        if (!child) {
+            child = node_new(p, strlen(p), 0);
+            if (!child) {
+                return -1;
+            }
+            child->next_sibling = node->first_child;
+            node->first_child = child;
+            node = child;
+            break;
+        }
+
+        size_t common = 0;
+        while (common < child->label_len && p[common] == child->label[common]) {
+            common++;
+        }
+        if (common < child->label_len) {
+            // Split the edge: child keeps the tail under a new middle node
+            struct radix_node *mid = node_new(child->label, common, 0);
+            if (!mid) {
+                return -1;
+            }
+            memmove(child->label, child->label + common, child->label_len - common + 1);
+            child->label_len -= common;
+
+            struct radix_node **link = &node->first_child;
+            while (*link != child) {
+                link = &(*link)->next_sibling;
+            }
+            mid->next_sibling = child->next_sibling;
+            child->next_sibling = NULL;
+            mid->first_child = child;
+            *link = mid;
+            child = mid;
+        }
+        p += common;
+        node = child;
+    }
+
+    if (node->bits == 0 && bits != 0) {
+        t->prefixes++;
+    }
+    node->bits |= bits;
+    return 0;
+}
+
+uint32_t path_radix_match(const path_radix *t, const char *path) {
+    char key[PATH_MAX];
+    if (!t->root || make_key(key, path) == 0) {
+        return 0;
+    }
+
+    // Every node on the way down is a prefix of the key ending at a '/'
+    // or in the middle of a component; only the former carry bits
+    const struct radix_node *node = t->root;
+    uint32_t bits = node->bits;
+    const char *p = key;
+    while (*p) {
+        const struct radix_node *child = child_for(node, *p);
+        if (!child || strncmp(child->label, p, child->label_len) != 0) {
+            break;
+        }
+        p += child->label_len;
+        node = child;
+        bits |= node->bits;
+    }
+    return bits;
+}
+
+static void free_node(struct radix_node *n) {
+    while (n) {
+        struct radix_node *next = n->next_sibling;
+        free_node(n->first_child);
+        free(n->label);
+        free(n);
+        n = next;
+    }
+}
+
+void path_radix_free(path_radix *t) {
+    free_node(t->root);
+    t->root = NULL;
+    t->prefixes = 0;
+}
@@ -0,0 +1,28 @@
+// path_radix.h
+#ifndef PATH_RADIX_H
+#define PATH_RADIX_H
+
+#include <stdint.h>
+
+struct radix_node;
+
+// Radix tree from directory prefixes to 32-bit sets. Prefixes only match
+// whole path components: "/srv/app" covers "/srv/app/config" but not
+// "/srv/application".
+typedef struct {
+    struct radix_node *root;
+    uint32_t prefixes;          // Distinct prefixes stored
+} path_radix;
+
+int path_radix_init(path_radix *t);
+
+// OR bits into the set stored for prefix
+int path_radix_insert(path_radix *t, const char *prefix, uint32_t bits);
+
+// OR of the sets of every stored prefix of path (path itself included).
+// Costs one walk down the tree, at most strlen(path) byte comparisons.
+uint32_t path_radix_match(const path_radix *t, const char *path);
+
+void path_radix_free(path_radix *t);
+
+#endif // PATH_RADIX_H
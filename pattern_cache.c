@@ -0,0 +1,481 @@
+// pattern_cache.c
+#include "pattern_cache.h"
+#include "hash_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC     "FWPC"
+#define CACHE_VERSION   2
+#define SLOT_EMPTY      UINT32_MAX
+#define SET_INCLUDE     0
+#define SET_EXCLUDE     1
+
+// Hash table slot for a literal, suffix or prefix string
+typedef struct {
+    uint32_t str_off;           // Offset of the string in the blob, SLOT_EMPTY if unused
+    uint32_t len;
+    uint32_t hash;
+} pattern_slot;
+
+// One compiled pattern list (all offsets are relative to the blob)
+typedef struct {
+    uint32_t count;             // Patterns in the set; 0 = set not in use
+    uint32_t match_all;         // Contains a bare "*"
+    uint32_t literal_slots, literal_cap;
+    uint32_t suffix_slots, suffix_cap;
+    uint32_t suffix_lens, suffix_len_count;     // Distinct suffix lengths
+    uint32_t prefix_slots, prefix_cap;
+    uint32_t prefix_lens, prefix_len_count;     // Distinct prefix lengths
+    uint32_t globs, glob_count;                 // String offsets for fnmatch
+} pattern_set;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t config_hash;
+    uint32_t blob_size;
+    uint32_t flags;             // PATTERN_* compile flags
+    pattern_set sets[2];
+} cache_header;
+
+// Growable blob under construction
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} blob_builder;
+
+// Reserve len zeroed bytes (4-byte aligned) and return their offset
+static int64_t blob_reserve(blob_builder *b, size_t len) {
+    size_t off = (b->len + 3) & ~(size_t)3;
+    if (off + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < off + len) {
+            cap *= 2;
+        }
+        char *grown = realloc(b->data, cap);
+        if (!grown) {
+            return -1;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memset(b->data + b->len, 0, off + len - b->len);
+    b->len = off + len;
+    return (int64_t)off;
+}
+
+static int64_t blob_string(blob_builder *b, const char *s, size_t len) {
+    int64_t off = blob_reserve(b, len + 1);
+    if (off >= 0) {
+        memcpy(b->data + off, s, len);
+    }
+    return off;
+}
+
+static uint32_t hash_bytes(const char *s, size_t len) {
+    return (uint32_t)xxh64(s, len, 0);
+}
+
+// Lower-case ASCII letters eight bytes at a time; other bytes are untouched
+static void ascii_fold(char *dst, const char *src, size_t len) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t high = 0x8080808080808080ULL;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x;
+        memcpy(&x, src + i, 8);
+
+        // Per byte: high bit of (b & 0x7f) + k is set iff (b & 0x7f) >= 0x80 - k
+        uint64_t low7 = x & ~high;
+        uint64_t ge_a = low7 + ones * (0x80 - 'A');
+        uint64_t gt_z = low7 + ones * (0x80 - 'Z' - 1);
+        uint64_t upper = (ge_a ^ gt_z) & ~x & high;
+
+        x |= upper >> 2;  // 0x80 >> 2 == 0x20, the case bit
+        memcpy(dst + i, &x, 8);
+    }
+    for (; i < len; i++) {
+        char c = src[i];
+        dst[i] = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+    }
+}
+
+static int has_glob_chars(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint32_t table_cap(uint32_t n) {
+    uint32_t cap = 8;
+    while (cap < n * 2) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+// Insert a string into a slot table inside the blob (duplicates are skipped)
+static int table_insert(blob_builder *b, uint32_t table, uint32_t cap, const char *s, size_t len) {
+    uint32_t hash = hash_bytes(s, len);
+    uint32_t slot = hash & (cap - 1);
+
+    for (;;) {
+        pattern_slot *ps = (pattern_slot *)(b->data + table) + slot;
+        if (ps->str_off == SLOT_EMPTY) {
+            break;
+        }
+        if (ps->hash == hash && ps->len == len && memcmp(b->data + ps->str_off, s, len) == 0) {
+            return 0;
+        }
+        slot = (slot + 1) & (cap - 1);
+    }
+
+    // The blob may move while the string is appended
+    int64_t off = blob_string(b, s, len);
+    if (off < 0) {
+        return -1;
+    }
+    pattern_slot *ps = (pattern_slot *)(b->data + table) + slot;
+    ps->str_off = (uint32_t)off;
+    ps->len = (uint32_t)len;
+    ps->hash = hash;
+    return 0;
+}
+
+// Record a length in a distinct-length list (max count entries)
+static void add_length(blob_builder *b, uint32_t list, uint32_t *count, uint32_t len) {
+    uint32_t *lens = (uint32_t *)(b->data + list);
+    for (uint32_t i = 0; i < *count; i++) {
+        if (lens[i] == len) {
+            return;
+        }
+    }
+    lens[(*count)++] = len;
+}
+
+static int64_t empty_table(blob_builder *b, uint32_t cap) {
+    int64_t off = blob_reserve(b, cap * sizeof(pattern_slot));
+    if (off >= 0) {
+        pattern_slot *slots = (pattern_slot *)(b->data + off);
+        for (uint32_t i = 0; i < cap; i++) {
+            slots[i].str_off = SLOT_EMPTY;
+        }
+    }
+    return off;
+}
+
+// Compile one pattern list into the blob
+static int compile_set(blob_builder *b, int which, char **patterns, int count, int flags) {
+    uint32_t literals = 0, suffixes = 0, prefixes = 0, globs = 0;
+
+    // First pass: size the tables
+    for (int i = 0; i < count; i++) {
+        const char *p = patterns[i];
+        size_t len = strlen(p);
+        if (strcmp(p, "*") == 0) {
+            continue;
+        } else if (!has_glob_chars(p, len)) {
+            literals++;
+        } else if (p[0] == '*' && !has_glob_chars(p + 1, len - 1)) {
+            suffixes++;
+        } else if (len > 0 && p[len - 1] == '*' && !has_glob_chars(p, len - 1)) {
+            prefixes++;
+        } else {
+            globs++;
+        }
+    }
+
+    pattern_set set;
+    memset(&set, 0, sizeof(set));
+    set.count = (uint32_t)count;
+    set.literal_cap = table_cap(literals);
+    set.suffix_cap = table_cap(suffixes);
+    set.prefix_cap = table_cap(prefixes);
+
+    int64_t lit = empty_table(b, set.literal_cap);
+    int64_t suf = empty_table(b, set.suffix_cap);
+    int64_t pre = empty_table(b, set.prefix_cap);
+    int64_t suf_lens = blob_reserve(b, (suffixes + 1) * sizeof(uint32_t));
+    int64_t pre_lens = blob_reserve(b, (prefixes + 1) * sizeof(uint32_t));
+    int64_t glob_list = blob_reserve(b, (globs + 1) * sizeof(uint32_t));
+    if (lit < 0 || suf < 0 || pre < 0 || suf_lens < 0 || pre_lens < 0 || glob_list < 0) {
+        return -1;
+    }
+    set.literal_slots = (uint32_t)lit;
+    set.suffix_slots = (uint32_t)suf;
+    set.prefix_slots = (uint32_t)pre;
+    set.suffix_lens = (uint32_t)suf_lens;
+    set.prefix_lens = (uint32_t)pre_lens;
+    set.globs = (uint32_t)glob_list;
+
+    // Second pass: fill them
+    for (int i = 0; i < count; i++) {
+        char folded[PATH_MAX];
+        const char *p = patterns[i];
+        size_t len = strlen(p);
+        int rc = 0;
+
+        if ((flags & PATTERN_ICASE) && len < sizeof(folded)) {
+            ascii_fold(folded, p, len + 1);
+            p = folded;
+        }
+
+        if (strcmp(p, "*") == 0) {
+            set.match_all = 1;
+        } else if (!has_glob_chars(p, len)) {
+            rc = table_insert(b, set.literal_slots, set.literal_cap, p, len);
+        } else if (p[0] == '*' && !has_glob_chars(p + 1, len - 1)) {
+            rc = table_insert(b, set.suffix_slots, set.suffix_cap, p + 1, len - 1);
+            add_length(b, set.suffix_lens, &set.suffix_len_count, (uint32_t)(len - 1));
+        } else if (len > 0 && p[len - 1] == '*' && !has_glob_chars(p, len - 1)) {
+            rc = table_insert(b, set.prefix_slots, set.prefix_cap, p, len - 1);
+            add_length(b, set.prefix_lens, &set.prefix_len_count, (uint32_t)(len - 1));
+        } else {
+            int64_t off = blob_string(b, p, len);
+            if (off < 0) {
+                return -1;
+            }
+            ((uint32_t *)(b->data + set.globs))[set.glob_count++] = (uint32_t)off;
+        }
+        if (rc < 0) {
+            return -1;
+        }
+    }
+
+    ((cache_header *)b->data)->sets[which] = set;
+    return 0;
+}
+
+uint64_t pattern_config_hash(char **includes, int include_count,
+                             char **excludes, int exclude_count, int flags) {
+    xxh64_state st;
+    uint32_t version = CACHE_VERSION;
+
+    xxh64_init(&st, 0);
+    xxh64_update(&st, &version, sizeof(version));
+    xxh64_update(&st, &flags, sizeof(flags));
+    xxh64_update(&st, &include_count, sizeof(include_count));
+    for (int i = 0; i < include_count; i++) {
+        xxh64_update(&st, includes[i], strlen(includes[i]) + 1);
+    }
+    xxh64_update(&st, &exclude_count, sizeof(exclude_count));
+    for (int i = 0; i < exclude_count; i++) {
+        xxh64_update(&st, excludes[i], strlen(excludes[i]) + 1);
+    }
+    return xxh64_digest(&st);
+}
+
+int pattern_compile(pattern_matcher *m, char **includes, int include_count,
+                    char **excludes, int exclude_count, int flags) {
+    blob_builder b = { NULL, 0, 0 };
+
+    if (blob_reserve(&b, sizeof(cache_header)) < 0 ||
+        compile_set(&b, SET_INCLUDE, includes, include_count, flags) < 0 ||
+        compile_set(&b, SET_EXCLUDE, excludes, exclude_count, flags) < 0) {
+        free(b.data);
+        return -1;
+    }
+
+    cache_header *hdr = (cache_header *)b.data;
+    memcpy(hdr->magic, CACHE_MAGIC, 4);
+    hdr->version = CACHE_VERSION;
+    hdr->config_hash = pattern_config_hash(includes, include_count, excludes, exclude_count, flags);
+    hdr->blob_size = (uint32_t)b.len;
+    hdr->flags = (uint32_t)flags;
+
+    m->blob = b.data;
+    m->len = b.len;
+    m->mapped = 0;
+    return 0;
+}
+
+// Check that a set's tables and strings lie inside the blob
+static int validate_set(const char *blob, size_t len, const pattern_set *set) {
+    const struct { uint32_t off, cap; } tables[3] = {
+        { set->literal_slots, set->literal_cap },
+        { set->suffix_slots, set->suffix_cap },
+        { set->prefix_slots, set->prefix_cap }
+    };
+
+    for (int t = 0; t < 3; t++) {
+        if ((uint64_t)tables[t].off + (uint64_t)tables[t].cap * sizeof(pattern_slot) > len ||
+            (tables[t].cap & (tables[t].cap - 1)) || tables[t].off % 4) {
+            return -1;
+        }
+        const pattern_slot *slots = (const pattern_slot *)(blob + tables[t].off);
+        for (uint32_t i = 0; i < tables[t].cap; i++) {
+            if (slots[i].str_off != SLOT_EMPTY &&
+                (uint64_t)slots[i].str_off + slots[i].len >= len) {
+                return -1;
+            }
+        }
+    }
+
+    if ((uint64_t)set->suffix_lens + set->suffix_len_count * 4ull > len ||
+        (uint64_t)set->prefix_lens + set->prefix_len_count * 4ull > len ||
+        (uint64_t)set->globs + set->glob_count * 4ull > len) {
+        return -1;
+    }
+    const uint32_t *globs = (const uint32_t *)(blob + set->globs);
+    for (uint32_t i = 0; i < set->glob_count; i++) {
+        if (globs[i] >= len || !memchr(blob + globs[i], '\0', len - globs[i])) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pattern_cache_load(pattern_matcher *m, const char *file, uint64_t config_hash) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(cache_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const cache_header *hdr = map;
+    if (memcmp(hdr->magic, CACHE_MAGIC, 4) != 0 || hdr->version != CACHE_VERSION ||
+        hdr->config_hash != config_hash || hdr->blob_size != (uint64_t)st.st_size ||
+        validate_set(map, (size_t)st.st_size, &hdr->sets[SET_INCLUDE]) < 0 ||
+        validate_set(map, (size_t)st.st_size, &hdr->sets[SET_EXCLUDE]) < 0) {
+        munmap(map, (size_t)st.st_size);
+        errno = ESTALE;
+        return -1;
+    }
+
+    m->blob = map;
+    m->len = (size_t)st.st_size;
+    m->mapped = 1;
+    return 0;
+}
+
+int pattern_cache_save(const pattern_matcher *m, const char *file) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        return -1;
+    }
+    int ok = fwrite(m->blob, 1, m->len, fp) == m->len;
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, file) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int table_lookup(const char *blob, uint32_t table, uint32_t cap, const char *s, size_t len) {
+    const pattern_slot *slots = (const pattern_slot *)(blob + table);
+    uint32_t hash = hash_bytes(s, len);
+    uint32_t slot = hash & (cap - 1);
+
+    while (slots[slot].str_off != SLOT_EMPTY) {
+        if (slots[slot].hash == hash && slots[slot].len == len &&
+            memcmp(blob + slots[slot].str_off, s, len) == 0) {
+            return 1;
+        }
+        slot = (slot + 1) & (cap - 1);
+    }
+    return 0;
+}
+
+// Does filename match any pattern of the set?
+static int set_match(const char *blob, const pattern_set *set, const char *filename, size_t len) {
+    if (set->match_all) {
+        return 1;
+    }
+    if (table_lookup(blob, set->literal_slots, set->literal_cap, filename, len)) {
+        return 1;
+    }
+
+    const uint32_t *lens = (const uint32_t *)(blob + set->suffix_lens);
+    for (uint32_t i = 0; i < set->suffix_len_count; i++) {
+        if (lens[i] <= len &&
+            table_lookup(blob, set->suffix_slots, set->suffix_cap, filename + len - lens[i], lens[i])) {
+            return 1;
+        }
+    }
+
+    lens = (const uint32_t *)(blob + set->prefix_lens);
+    for (uint32_t i = 0; i < set->prefix_len_count; i++) {
+        if (lens[i] <= len &&
+            table_lookup(blob, set->prefix_slots, set->prefix_cap, filename, lens[i])) {
+            return 1;
+        }
+    }
+
+    const uint32_t *globs = (const uint32_t *)(blob + set->globs);
+    for (uint32_t i = 0; i < set->glob_count; i++) {
+        if (fnmatch(blob + globs[i], filename, 0) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int pattern_matches_nothing(const pattern_matcher *m) {
+    const cache_header *hdr = m->blob;
+    return hdr->sets[SET_EXCLUDE].match_all != 0;
+}
+
+int pattern_match(const pattern_matcher *m, const char *filename) {
+    const char *blob = m->blob;
+    const cache_header *hdr = m->blob;
+    size_t len = strlen(filename);
+    char folded[PATH_MAX];
+
+    // Patterns were folded at compile time; fold the name once to match
+    if ((hdr->flags & PATTERN_ICASE) && len < sizeof(folded)) {
+        ascii_fold(folded, filename, len + 1);
+        filename = folded;
+    }
+
+    if (hdr->sets[SET_INCLUDE].count &&
+        !set_match(blob, &hdr->sets[SET_INCLUDE], filename, len)) {
+        return 0;
+    }
+    if (hdr->sets[SET_EXCLUDE].count &&
+        set_match(blob, &hdr->sets[SET_EXCLUDE], filename, len)) {
+        return 0;
+    }
+    return 1;
+}
+
+void pattern_free(pattern_matcher *m) {
+    if (m->mapped) {
+        munmap(m->blob, m->len);
+    } else {
+        free(m->blob);
+    }
+    m->blob = NULL;
+    m->len = 0;
+    m->mapped = 0;
+}
@@ -0,0 +1,44 @@
+// pattern_cache.h
+#ifndef PATTERN_CACHE_H
+#define PATTERN_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled include/exclude patterns. Everything lives in one position-
+// independent blob, so a cache file can be mmap'd and used as-is.
+typedef struct {
+    void *blob;
+    size_t len;
+    int mapped;                 // Blob is an mmap of a cache file
+} pattern_matcher;
+
+// Compile flags
+#define PATTERN_ICASE 0x1       // Match ASCII letters case-insensitively
+
+// Hash identifying a pattern configuration (cache key)
+uint64_t pattern_config_hash(char **includes, int include_count,
+                             char **excludes, int exclude_count, int flags);
+
+// Compile patterns into m: literals, "*suffix" and "prefix*" patterns go
+// into hash tables, everything else falls back to fnmatch. With
+// PATTERN_ICASE the patterns are folded to lower case here, once.
+int pattern_compile(pattern_matcher *m, char **includes, int include_count,
+                    char **excludes, int exclude_count, int flags);
+
+// Map a cache file; fails unless it was written for config_hash
+int pattern_cache_load(pattern_matcher *m, const char *file, uint64_t config_hash);
+
+// Write the compiled blob to a cache file (atomically)
+int pattern_cache_save(const pattern_matcher *m, const char *file);
+
+// Does filename match an include pattern (or are there none) and no exclude?
+int pattern_match(const pattern_matcher *m, const char *filename);
+
+// Is every name excluded (an exclude pattern of "*")?
+int pattern_matches_nothing(const pattern_matcher *m);
+
+// Release the blob
+void pattern_free(pattern_matcher *m);
+
+#endif // PATTERN_CACHE_H
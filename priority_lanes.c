@@ -0,0 +1,343 @@
+// priority_lanes.c
+#include "priority_lanes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fnmatch.h>
+
+#define MAX_LANE_RULES  64
+#define SPILL_CHUNK     (64 * 1024)     // Spill write buffer and read-back unit
+
+// One classification rule
+typedef struct {
+    int lane;
+    int is_prefix;              // Directory prefix or filename glob?
+    char *spec;
+    size_t spec_len;
+} lane_rule;
+
+// FIFO of raw inotify records (header + name), stored back to back.
+// Once a lane spills, every newer record goes to its spill file until the
+// file has been read back, so the lane stays in arrival order.
+typedef struct {
+    char *buf;
+    size_t head;                // Next record to hand out
+    size_t tail;                // End of queued data
+    size_t cap;
+    uint32_t count;             // Records in memory
+    int spill_fd;               // Unlinked append-only file, -1 until needed
+    off_t spill_pos;            // Next record to read back
+    off_t spill_end;            // End of data written to the file
+    uint32_t spill_count;       // Records in the file or its write buffer
+    char *wbuf;                 // Appends not yet written
+    size_t wlen;
+} lane_queue;
+
+static lane_rule rules[MAX_LANE_RULES];
+static int rule_count = 0;
+static lane_queue queues[LANE_COUNT] = {
+    { .spill_fd = -1 }, { .spill_fd = -1 }, { .spill_fd = -1 }, { .spill_fd = -1 }
+};
+static size_t mem_budget = 0;           // 0 = unbounded
+static size_t mem_used = 0;             // Queued bytes held in memory
+static const char *spill_directory = NULL;
+
+static const char *lane_names[LANE_COUNT] = { "critical", "high", "normal", "low" };
+
+static int parse_level(const char *level, size_t len) {
+    for (int i = 0; i < LANE_COUNT; i++) {
+        if (strlen(lane_names[i]) == len && strncasecmp(level, lane_names[i], len) == 0) {
+            return i;
+        }
+    }
+    if (len == 1 && level[0] >= '0' && level[0] < '0' + LANE_COUNT) {
+        return level[0] - '0';
+    }
+    return -1;
+}
+
+int lanes_add_rule(const char *rule) {
+    const char *colon = strchr(rule, ':');
+    if (!colon || colon[1] == '\0' || rule_count == MAX_LANE_RULES) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int lane = parse_level(rule, (size_t)(colon - rule));
+    if (lane < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char *spec = strdup(colon + 1);
+    if (!spec) {
+        return -1;
+    }
+
+    lane_rule *r = &rules[rule_count++];
+    r->lane = lane;
+    r->is_prefix = strchr(spec, '/') != NULL;
+    r->spec = spec;
+    r->spec_len = strlen(spec);
+
+    // "/srv/app/" and "/srv/app" name the same subtree
+    while (r->is_prefix && r->spec_len > 1 && spec[r->spec_len - 1] == '/') {
+        spec[--r->spec_len] = '\0';
+    }
+    return 0;
+}
+
+int lanes_has_rules() {
+    return rule_count > 0;
+}
+
+int lanes_classify(const char *path, const char *filename) {
+    int lane = LANE_COUNT;
+
+    for (int i = 0; i < rule_count; i++) {
+        const lane_rule *r = &rules[i];
+        if (r->lane >= lane) {
+            continue;  // Can't improve on what we already have
+        }
+
+        int match;
+        if (r->is_prefix) {
+            match = strncmp(path, r->spec, r->spec_len) == 0 &&
+                    (path[r->spec_len] == '\0' || path[r->spec_len] == '/');
+        } else {
+            match = fnmatch(r->spec, filename, 0) == 0;
+        }
+        if (match) {
+            lane = r->lane;
+        }
+    }
+
+    // Unclassified events go to the normal lane, so rules can also demote
+    return lane == LANE_COUNT ? LANE_NORMAL : lane;
+}
+
+int lanes_set_budget(size_t bytes, const char *spill_dir) {
+    mem_budget = bytes;
+    spill_directory = spill_dir;
+    return 0;
+}
+
+// Create the lane's spill file; it is unlinked so nothing outlives the process
+static int open_spill(lane_queue *q) {
+    int fd = open(spill_directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        // Filesystems without O_TMPFILE
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/fswatcher-spill-XXXXXX", spill_directory);
+        fd = mkstemp(path);
+        if (fd < 0) {
+            return -1;
+        }
+        unlink(path);
+    }
+
+    q->wbuf = malloc(SPILL_CHUNK);
+    if (!q->wbuf) {
+        close(fd);
+        return -1;
+    }
+    q->spill_fd = fd;
+    q->spill_pos = q->spill_end = 0;
+    return 0;
+}
+
+// Write buffered appends to the spill file
+static int flush_spill(lane_queue *q) {
+    size_t done = 0;
+    while (done < q->wlen) {
+        ssize_t n = pwrite(q->spill_fd, q->wbuf + done, q->wlen - done, q->spill_end + (off_t)done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    q->spill_end += (off_t)q->wlen;
+    q->wlen = 0;
+    return 0;
+}
+
+// Append a record to the lane's spill file
+static int spill_push(lane_queue *q, const struct inotify_event *event, size_t len) {
+    if (q->spill_fd < 0 && open_spill(q) < 0) {
+        return -1;
+    }
+    if (q->wlen + len > SPILL_CHUNK && flush_spill(q) < 0) {
+        return -1;
+    }
+    memcpy(q->wbuf + q->wlen, event, len);
+    q->wlen += len;
+    q->spill_count++;
+    return 0;
+}
+
+// Read the next chunk of spilled records into the (empty) memory queue
+static int refill(lane_queue *q) {
+    if (q->wlen && flush_spill(q) < 0) {
+        return -1;
+    }
+
+    if (q->cap < SPILL_CHUNK) {
+        char *grown = realloc(q->buf, SPILL_CHUNK);
+        if (!grown) {
+            return -1;
+        }
+        q->buf = grown;
+        q->cap = SPILL_CHUNK;
+    }
+
+    off_t avail = q->spill_end - q->spill_pos;
+    ssize_t n = pread(q->spill_fd, q->buf, avail < SPILL_CHUNK ? (size_t)avail : SPILL_CHUNK,
+                      q->spill_pos);
+    if (n <= 0) {
+        return -1;
+    }
+
+    // Only take whole records; a partial one is read again next time
+    size_t off = 0;
+    uint32_t records = 0;
+    while (off + sizeof(struct inotify_event) <= (size_t)n) {
+        const struct inotify_event *event = (const struct inotify_event *)(q->buf + off);
+        size_t len = sizeof(*event) + event->len;
+        if (off + len > (size_t)n) {
+            break;
+        }
+        off += len;
+        records++;
+    }
+
+    q->head = 0;
+    q->tail = off;
+    q->count = records;
+    mem_used += off;
+    q->spill_pos += (off_t)off;
+    q->spill_count -= records;
+
+    // Fully read back: reclaim the disk space
+    if (!q->spill_count) {
+        if (ftruncate(q->spill_fd, 0) < 0) {
+            return -1;
+        }
+        q->spill_pos = q->spill_end = 0;
+    }
+    return 0;
+}
+
+int lanes_push(int lane, const struct inotify_event *event) {
+    lane_queue *q = &queues[lane];
+    size_t len = sizeof(*event) + event->len;
+
+    if (q->spill_count || (mem_budget && mem_used + len > mem_budget)) {
+        return spill_push(q, event, len);
+    }
+
+    if (q->tail + len > q->cap) {
+        // Reclaim the consumed prefix before growing
+        if (q->head > 0) {
+            memmove(q->buf, q->buf + q->head, q->tail - q->head);
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        if (q->tail + len > q->cap) {
+            size_t cap = q->cap ? q->cap * 2 : 64 * 1024;
+            while (cap < q->tail + len) {
+                cap *= 2;
+            }
+            char *grown = realloc(q->buf, cap);
+            if (!grown) {
+                return -1;
+            }
+            q->buf = grown;
+            q->cap = cap;
+        }
+    }
+
+    memcpy(q->buf + q->tail, event, len);
+    q->tail += len;
+    q->count++;
+    mem_used += len;
+    return 0;
+}
+
+uint32_t lanes_pending() {
+    uint32_t pending = 0;
+    for (int i = 0; i < LANE_COUNT; i++) {
+        pending += queues[i].count + queues[i].spill_count;
+    }
+    return pending;
+}
+
+uint32_t lanes_spilled() {
+    uint32_t spilled = 0;
+    for (int i = 0; i < LANE_COUNT; i++) {
+        spilled += queues[i].spill_count;
+    }
+    return spilled;
+}
+
+uint32_t lanes_drain(uint32_t budget, lane_handler handler) {
+    uint32_t handled = 0;
+    int lane = 0;
+
+    while (handled < budget && lane < LANE_COUNT) {
+        lane_queue *q = &queues[lane];
+        if (!q->count && q->spill_count && refill(q) < 0) {
+            // Unreadable spill file: give up on it rather than wedge the lane
+            q->spill_count = 0;
+            q->wlen = 0;
+            q->spill_pos = q->spill_end = 0;
+        }
+        if (!q->count) {
+            lane++;
+            continue;
+        }
+
+        // Handlers must not push: the record lives in the queue buffer
+        const struct inotify_event *event = (const struct inotify_event *)(q->buf + q->head);
+        size_t len = sizeof(*event) + event->len;
+        handler(event);
+        q->head += len;
+        q->count--;
+        mem_used -= len;
+        handled++;
+
+        if (!q->count) {
+            q->head = q->tail = 0;
+        }
+    }
+    return handled;
+}
+
+const char *lane_name(int lane) {
+    return lane >= 0 && lane < LANE_COUNT ? lane_names[lane] : "unknown";
+}
+
+void lanes_cleanup() {
+    for (int i = 0; i < rule_count; i++) {
+        free(rules[i].spec);
+    }
+    rule_count = 0;
+
+    for (int i = 0; i < LANE_COUNT; i++) {
+        if (queues[i].spill_fd >= 0) {
+            close(queues[i].spill_fd);
+        }
+        free(queues[i].buf);
+        free(queues[i].wbuf);
+        memset(&queues[i], 0, sizeof(queues[i]));
+        queues[i].spill_fd = -1;
+    }
+    mem_used = 0;
+}
@@ -0,0 +1,54 @@
+// priority_lanes.h
+#ifndef PRIORITY_LANES_H
+#define PRIORITY_LANES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+
+// Lanes in scheduling order; lower numbers are always drained first
+#define LANE_CRITICAL   0
+#define LANE_HIGH       1
+#define LANE_NORMAL     2
+#define LANE_LOW        3
+#define LANE_COUNT      4
+
+// Handles one queued event
+typedef void (*lane_handler)(const struct inotify_event *event);
+
+// Add a classification rule "LEVEL:SPEC". SPEC containing a '/' is a
+// directory prefix (per root/subtree), anything else a filename glob.
+int lanes_add_rule(const char *rule);
+
+// Are any rules configured?
+int lanes_has_rules();
+
+// Pick the lane for an event; the highest-priority matching rule wins.
+// Both halves of a rename must share a lane to stay in order, so callers
+// queue an IN_MOVED_FROM/IN_MOVED_TO pair on the more urgent of the two.
+int lanes_classify(const char *path, const char *filename);
+
+// Cap the memory held by all lanes; events beyond it are appended to a
+// per-lane spill file in spill_dir and read back in order. 0 = unbounded.
+int lanes_set_budget(size_t bytes, const char *spill_dir);
+
+// Queue a copy of an event on a lane
+int lanes_push(int lane, const struct inotify_event *event);
+
+// Number of queued events across all lanes (in memory and spilled)
+uint32_t lanes_pending();
+
+// Number of queued events currently held on disk
+uint32_t lanes_spilled();
+
+// Handle up to budget events, always taking from the highest non-empty lane.
+// Returns the number handled.
+uint32_t lanes_drain(uint32_t budget, lane_handler handler);
+
+// Lane name for messages
+const char *lane_name(int lane);
+
+// Release queues and rules
+void lanes_cleanup();
+
+#endif // PRIORITY_LANES_H
@@ -0,0 +1,55 @@
+// sampling.c
+#include "sampling.h"
+#include "hash_utils.h"
+#include <errno.h>
+#include <string.h>
+
+#define SAMPLING_SEED 0x66737761746368ULL  // Fixed so decisions survive restarts
+
+static double sample_fraction = 1.0;
+static uint64_t threshold = UINT64_MAX;     // Keep paths hashing at or below this
+static uint64_t events_seen = 0;
+static uint64_t events_kept = 0;
+
+int sampling_init(double fraction) {
+    if (!(fraction > 0.0 && fraction <= 1.0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sample_fraction = fraction;
+    threshold = fraction >= 1.0 ? UINT64_MAX : (uint64_t)(fraction * 18446744073709551616.0);
+    sampling_reset();
+    return 0;
+}
+
+int sampling_keep(const char *dir, const char *name) {
+    xxh64_state st;
+
+    // Hash dir + "/" + name without building the full path
+    xxh64_init(&st, SAMPLING_SEED);
+    xxh64_update(&st, dir, strlen(dir));
+    xxh64_update(&st, "/", 1);
+    xxh64_update(&st, name, strlen(name));
+
+    events_seen++;
+    if (xxh64_digest(&st) > threshold) {
+        return 0;
+    }
+    events_kept++;
+    return 1;
+}
+
+void sampling_stats(uint64_t *seen, uint64_t *kept) {
+    *seen = events_seen;
+    *kept = events_kept;
+}
+
+uint64_t sampling_estimate(uint64_t kept) {
+    return (uint64_t)((double)kept / sample_fraction + 0.5);
+}
+
+void sampling_reset() {
+    events_seen = 0;
+    events_kept = 0;
+}
@@ -0,0 +1,23 @@
+// sampling.h
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stdint.h>
+
+// Keep roughly fraction (0 < fraction <= 1) of all paths
+int sampling_init(double fraction);
+
+// Is the path dir/name in the sample? The decision depends only on the
+// path, so a file is either always or never sampled. Counts the event.
+int sampling_keep(const char *dir, const char *name);
+
+// Events seen and kept since the last reset
+void sampling_stats(uint64_t *seen, uint64_t *kept);
+
+// Estimate of the true event count from the sampled count
+uint64_t sampling_estimate(uint64_t kept);
+
+// Start a new counting period
+void sampling_reset();
+
+#endif // SAMPLING_H
@@ -0,0 +1,407 @@
+// scrub.c
+#include "scrub.h"
+#include "hash_utils.h"
+#include "intern.h"
+#include "path_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define TOUCH_MAX 32            // Names remembered per directory before it counts as all touched
+
+// One entry of a listing. Names live in the listing's own pool and are
+// freed with it; only names that become suspects are interned, so a
+// churn of uniquely named temp files does not grow the intern table.
+typedef struct {
+    uint64_t hash;              // fnv1a_str() of the name
+    uint32_t name;              // Offset of the name in the pool
+    uint32_t is_dir;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_ns;
+} scrub_entry;
+
+// What a directory held at one visit, sorted by name hash, then name
+typedef struct {
+    scrub_entry *entries;
+    char *names;
+    uint32_t count;
+} scrub_listing;
+
+typedef struct {
+    char *path;
+    int tag;
+    int visited;
+    scrub_listing last;
+    uint64_t touched[TOUCH_MAX];    // Name hashes
+    uint32_t touched_count;
+    int touched_all;            // More changes than touched[] holds
+} scrub_dir;
+
+// A difference waiting for confirmation
+typedef struct {
+    uint32_t dir;
+    uint32_t name_id;
+    uint64_t hash;
+    uint32_t mask;
+} scrub_suspect;
+
+static scrub_dir *dirs = NULL;
+static uint32_t dir_count = 0;
+static uint32_t dir_cap = 0;
+static path_map dir_ids;
+static scrub_suspect *suspects = NULL;
+static uint32_t suspect_count = 0;
+static uint32_t suspect_cap = 0;
+static scrub_stats stats;
+static const char *sort_names = NULL;   // Pool of the listing being sorted (qsort has no user pointer)
+
+int scrub_init() {
+    scrub_cleanup();
+    return path_map_init(&dir_ids, 256);
+}
+
+static uint32_t dir_record(const char *path, int create) {
+    uint32_t idx;
+    if (path_map_get(&dir_ids, path, &idx)) {
+        return idx;
+    }
+    if (!create) {
+        return UINT32_MAX;
+    }
+
+    if (dir_count == dir_cap) {
+        uint32_t cap = dir_cap ? dir_cap * 2 : 256;
+        scrub_dir *grown = realloc(dirs, cap * sizeof(*dirs));
+        if (!grown) {
+            return UINT32_MAX;
+        }
+        dirs = grown;
+        dir_cap = cap;
+    }
+    idx = dir_count;
+    memset(&dirs[idx], 0, sizeof(dirs[idx]));
+    dirs[idx].path = strdup(path);
+    if (!dirs[idx].path || path_map_put(&dir_ids, path, idx) < 0) {
+        free(dirs[idx].path);
+        return UINT32_MAX;
+    }
+    dir_count++;
+    return idx;
+}
+
+// Forget a directory: move the last record into its place so dirs[] stays
+// dense, and re-point the map and any suspects at the moved record
+static void drop_dir(uint32_t idx) {
+    for (uint32_t i = 0; i < suspect_count; ) {
+        if (suspects[i].dir == idx) {
+            suspects[i] = suspects[--suspect_count];
+        } else {
+            i++;
+        }
+    }
+
+    path_map_remove(&dir_ids, dirs[idx].path);
+    free(dirs[idx].path);
+    free(dirs[idx].last.entries);
+    free(dirs[idx].last.names);
+
+    uint32_t last = --dir_count;
+    if (idx != last) {
+        dirs[idx] = dirs[last];
+        path_map_put(&dir_ids, dirs[idx].path, idx);
+        for (uint32_t i = 0; i < suspect_count; i++) {
+            if (suspects[i].dir == last) {
+                suspects[i].dir = idx;
+            }
+        }
+    }
+}
+
+static int is_touched(const scrub_dir *d, uint64_t hash) {
+    if (d->touched_all) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < d->touched_count; i++) {
+        if (d->touched[i] == hash) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void scrub_touch(const char *dir, const char *name) {
+    uint32_t idx = dir_record(dir, 0);
+    if (idx == UINT32_MAX || !dirs[idx].visited) {
+        return;  // Nothing recorded to disagree with yet
+    }
+
+    scrub_dir *d = &dirs[idx];
+    uint64_t hash = fnv1a_str(name);
+    if (!is_touched(d, hash)) {
+        if (d->touched_count < TOUCH_MAX) {
+            d->touched[d->touched_count++] = hash;
+        } else {
+            d->touched_all = 1;
+        }
+    }
+
+    // Explained after all
+    for (uint32_t i = 0; i < suspect_count; ) {
+        if (suspects[i].dir == idx && suspects[i].hash == hash) {
+            suspects[i] = suspects[--suspect_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void suspect(uint32_t dir, const scrub_listing *l, const scrub_entry *e, uint32_t mask) {
+    uint32_t name_id = intern(l->names + e->name);
+    if (name_id == INTERN_NONE) {
+        return;  // Caught again on the next pass
+    }
+    if (suspect_count == suspect_cap) {
+        uint32_t cap = suspect_cap ? suspect_cap * 2 : 64;
+        scrub_suspect *grown = realloc(suspects, cap * sizeof(*suspects));
+        if (!grown) {
+            return;  // Caught again on the next pass
+        }
+        suspects = grown;
+        suspect_cap = cap;
+    }
+    suspects[suspect_count].dir = dir;
+    suspects[suspect_count].name_id = name_id;
+    suspects[suspect_count].hash = e->hash;
+    suspects[suspect_count].mask = mask;
+    suspect_count++;
+    stats.suspects++;
+}
+
+// Order of two entries, each from its own listing's pool
+static int compare_entries(const scrub_entry *a, const char *a_names,
+                           const scrub_entry *b, const char *b_names) {
+    if (a->hash != b->hash) {
+        return a->hash < b->hash ? -1 : 1;
+    }
+    return strcmp(a_names + a->name, b_names + b->name);
+}
+
+static int by_name(const void *a, const void *b) {
+    return compare_entries(a, sort_names, b, sort_names);
+}
+
+// Read dir into a sorted listing
+static int list_dir(const char *path, scrub_listing *out) {
+    int dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        return -1;
+    }
+    DIR *dir = fdopendir(dfd);
+    if (!dir) {
+        close(dfd);
+        return -1;
+    }
+
+    scrub_entry *list = NULL;
+    char *names = NULL;
+    uint32_t n = 0, cap = 0;
+    size_t used = 0, names_cap = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        struct stat st;
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0 ||
+            fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            continue;
+        }
+        size_t len = strlen(de->d_name) + 1;
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            scrub_entry *grown = realloc(list, cap * sizeof(*list));
+            if (!grown) {
+                break;
+            }
+            list = grown;
+        }
+        if (used + len > names_cap) {
+            names_cap = names_cap ? names_cap * 2 : 4096;
+            char *grown = realloc(names, names_cap);
+            if (!grown) {
+                break;
+            }
+            names = grown;
+        }
+        memcpy(names + used, de->d_name, len);
+        list[n].hash = fnv1a_str(de->d_name);
+        list[n].name = (uint32_t)used;
+        list[n].is_dir = S_ISDIR(st.st_mode);
+        list[n].ino = (uint64_t)st.st_ino;
+        list[n].size = (uint64_t)st.st_size;
+        list[n].mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        used += len;
+        n++;
+    }
+    closedir(dir);
+
+    sort_names = names;
+    qsort(list, n, sizeof(*list), by_name);
+    sort_names = NULL;
+    out->entries = list;
+    out->names = names;
+    out->count = n;
+    return 0;
+}
+
+// Take a listing as the known state of a directory nothing is recorded
+// for yet. Its files can't be judged, but a subdirectory may have appeared
+// before its parent was watched, so those are staged (as creates) for the
+// caller to check against its watches.
+static void record_first(uint32_t idx, const scrub_listing *now) {
+    for (uint32_t i = 0; i < now->count; i++) {
+        if (now->entries[i].is_dir) {
+            suspect(idx, now, &now->entries[i], IN_CREATE | IN_ISDIR);
+        }
+    }
+}
+
+// Swap in a new listing and start collecting touches afresh
+static void record_listing(scrub_dir *d, const scrub_listing *now) {
+    free(d->last.entries);
+    free(d->last.names);
+    d->last = *now;
+    d->visited = 1;
+    d->touched_count = 0;
+    d->touched_all = 0;
+}
+
+int scrub_seed(const char *path, int tag) {
+    // List first: this can run from scrub_confirm()'s emit callback (a
+    // replayed mkdir), where no record may be dropped
+    scrub_listing now;
+    if (list_dir(path, &now) < 0) {
+        return -1;
+    }
+
+    uint32_t idx = dir_record(path, 1);
+    if (idx == UINT32_MAX) {
+        free(now.entries);
+        free(now.names);
+        return -1;
+    }
+
+    dirs[idx].tag = tag;
+    record_first(idx, &now);
+    record_listing(&dirs[idx], &now);
+    return (int)now.count;
+}
+
+void scrub_forget_tree(const char *root) {
+    size_t len = strlen(root);
+    for (uint32_t i = dir_count; i-- > 0; ) {
+        const char *path = dirs[i].path;
+        if (strncmp(path, root, len) == 0 && (path[len] == '\0' || path[len] == '/')) {
+            drop_dir(i);
+        }
+    }
+}
+
+int scrub_visit(const char *path, int tag) {
+    uint32_t idx = dir_record(path, 1);
+    if (idx == UINT32_MAX) {
+        return 0;
+    }
+
+    scrub_listing now;
+    if (list_dir(path, &now) < 0) {
+        drop_dir(idx);
+        return -1;
+    }
+
+    scrub_dir *d = &dirs[idx];
+    const scrub_listing *was = &d->last;
+    d->tag = tag;
+    stats.dirs++;
+    stats.entries += now.count;
+
+    if (!d->visited) {
+        record_first(idx, &now);
+    } else {
+        // Merge the two sorted listings
+        uint32_t i = 0, j = 0;
+        while (i < was->count || j < now.count) {
+            const scrub_entry *old = i < was->count ? &was->entries[i] : NULL;
+            const scrub_entry *is = j < now.count ? &now.entries[j] : NULL;
+            int order = !old ? 1 : !is ? -1 : compare_entries(old, was->names, is, now.names);
+
+            if (order > 0) {
+                if (!is_touched(d, is->hash)) {
+                    suspect(idx, &now, is, IN_CREATE | (is->is_dir ? IN_ISDIR : 0));
+                }
+                j++;
+            } else if (order < 0) {
+                if (!is_touched(d, old->hash)) {
+                    suspect(idx, was, old, IN_DELETE | (old->is_dir ? IN_ISDIR : 0));
+                }
+                i++;
+            } else {
+                if (!is_touched(d, is->hash)) {
+                    if (is->ino != old->ino || is->is_dir != old->is_dir) {
+                        suspect(idx, &now, is, IN_CREATE | (is->is_dir ? IN_ISDIR : 0));
+                    } else if (!is->is_dir && (is->size != old->size || is->mtime_ns != old->mtime_ns)) {
+                        suspect(idx, &now, is, IN_MODIFY);
+                    }
+                }
+                i++;
+                j++;
+            }
+        }
+    }
+
+    record_listing(d, &now);
+    return (int)now.count;
+}
+
+uint32_t scrub_confirm(scrub_emit_fn emit, void *arg) {
+    uint32_t corrected = 0;
+
+    // The emit callback may touch (and so reorder) the list; take it first
+    scrub_suspect *list = suspects;
+    uint32_t count = suspect_count;
+    suspects = NULL;
+    suspect_count = suspect_cap = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const scrub_dir *d = &dirs[list[i].dir];
+        const char *name = intern_string(list[i].name_id);
+        if (name && emit(d->tag, d->path, name, list[i].mask, arg)) {
+            corrected++;
+        }
+    }
+    free(list);
+    stats.corrections += corrected;
+    return corrected;
+}
+
+void scrub_get_stats(scrub_stats *out) {
+    *out = stats;
+}
+
+void scrub_cleanup() {
+    for (uint32_t i = 0; i < dir_count; i++) {
+        free(dirs[i].path);
+        free(dirs[i].last.entries);
+        free(dirs[i].last.names);
+    }
+    free(dirs);
+    free(suspects);
+    path_map_free(&dir_ids);
+    dirs = NULL;
+    suspects = NULL;
+    dir_count = dir_cap = 0;
+    suspect_count = suspect_cap = 0;
+    memset(&stats, 0, sizeof(stats));
+}
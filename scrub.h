@@ -0,0 +1,52 @@
+// scrub.h
+#ifndef SCRUB_H
+#define SCRUB_H
+
+#include <stdint.h>
+
+// Called for each confirmed discrepancy with the tag given to
+// scrub_visit(), the entry name and an inotify mask describing the
+// missed change (IN_CREATE, IN_DELETE or IN_MODIFY, plus IN_ISDIR).
+// Returns 1 if it was a real correction, 0 if the caller knew better.
+typedef int (*scrub_emit_fn)(int tag, const char *dir, const char *name, uint32_t mask, void *arg);
+
+// Scrubber totals
+typedef struct {
+    uint64_t dirs;              // Directory visits
+    uint64_t entries;           // Entries compared
+    uint64_t suspects;          // Differences staged for confirmation
+    uint64_t corrections;       // Differences no event explained
+} scrub_stats;
+
+int scrub_init();
+
+// An event was seen for dir/name; its changes are not drift
+void scrub_touch(const char *dir, const char *name);
+
+// Record what dir holds as it starts being watched, so the first visit
+// already has a known state to compare with and catches anything missed
+// in between. Nothing can be judged yet, so only subdirectories are
+// staged (as creates) for the caller to check against its watches.
+// Returns the number of entries recorded, or -1 if dir can't be listed.
+int scrub_seed(const char *dir, int tag);
+
+// List dir and compare it with what was recorded when it was seeded or
+// last visited. Differences not explained by an event since then are
+// staged, not reported: the event may still be in the kernel queue. A
+// directory never seeded is treated as by scrub_seed(). Returns the
+// number of entries compared, or -1 if dir is gone (its record is dropped).
+int scrub_visit(const char *dir, int tag);
+
+// Drop the records of root and every directory below it
+void scrub_forget_tree(const char *root);
+
+// Report the staged differences that no event has explained since. Only
+// call once every event queued before the visit has been touched.
+// Returns the number of corrections.
+uint32_t scrub_confirm(scrub_emit_fn emit, void *arg);
+
+void scrub_get_stats(scrub_stats *out);
+
+void scrub_cleanup();
+
+#endif // SCRUB_H
@@ -0,0 +1,114 @@
+// summary.c
+#include "summary.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+
+#define SLOT_EMPTY INT32_MIN
+
+// One directory's counters for the current window
+typedef struct {
+    int32_t wd;                 // SLOT_EMPTY when unused
+    uint32_t counts[SUMMARY_TYPES];
+} summary_slot;
+
+static summary_slot *slots = NULL;
+static uint32_t slot_cap = 0;
+static uint32_t slot_used = 0;
+static uint32_t other_counts[SUMMARY_TYPES];   // Directories beyond the table's capacity
+static uint64_t window_total = 0;
+
+static const char *type_names[SUMMARY_TYPES] = {
+    "created", "deleted", "modified", "moved_from", "moved_to", "attrib"
+};
+
+int summary_init(uint32_t max_dirs) {
+    uint32_t cap = 16;
+    while (cap < max_dirs * 2) {
+        cap *= 2;
+    }
+
+    slots = malloc(cap * sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < cap; i++) {
+        slots[i].wd = SLOT_EMPTY;
+    }
+    slot_cap = cap;
+    slot_used = 0;
+    memset(other_counts, 0, sizeof(other_counts));
+    window_total = 0;
+    return 0;
+}
+
+// Map an inotify mask to a counter; -1 if the event isn't summarized
+static int mask_type(uint32_t mask) {
+    if (mask & IN_CREATE)     return SUMMARY_CREATED;
+    if (mask & IN_DELETE)     return SUMMARY_DELETED;
+    if (mask & IN_MODIFY)     return SUMMARY_MODIFIED;
+    if (mask & IN_MOVED_FROM) return SUMMARY_MOVED_FROM;
+    if (mask & IN_MOVED_TO)   return SUMMARY_MOVED_TO;
+    if (mask & IN_ATTRIB)     return SUMMARY_ATTRIB;
+    return -1;
+}
+
+void summary_record(int wd, uint32_t mask) {
+    int type = mask_type(mask);
+    if (type < 0 || !slot_cap) {
+        return;
+    }
+    window_total++;
+
+    uint32_t slot = ((uint32_t)wd * 2654435761u) & (slot_cap - 1);
+    while (slots[slot].wd != SLOT_EMPTY) {
+        if (slots[slot].wd == wd) {
+            slots[slot].counts[type]++;
+            return;
+        }
+        slot = (slot + 1) & (slot_cap - 1);
+    }
+
+    // Keep probes short; late directories share one bucket for the window
+    if ((slot_used + 1) * 4 > slot_cap * 3) {
+        other_counts[type]++;
+        return;
+    }
+
+    slots[slot].wd = wd;
+    memset(slots[slot].counts, 0, sizeof(slots[slot].counts));
+    slots[slot].counts[type] = 1;
+    slot_used++;
+}
+
+uint64_t summary_emit(summary_emit_cb cb) {
+    for (uint32_t i = 0; i < slot_cap && slot_used; i++) {
+        if (slots[i].wd != SLOT_EMPTY) {
+            cb(slots[i].wd, slots[i].counts);
+            slots[i].wd = SLOT_EMPTY;
+            slot_used--;
+        }
+    }
+
+    for (int t = 0; t < SUMMARY_TYPES; t++) {
+        if (other_counts[t]) {
+            cb(SUMMARY_OTHER_WD, other_counts);
+            break;
+        }
+    }
+    memset(other_counts, 0, sizeof(other_counts));
+
+    uint64_t total = window_total;
+    window_total = 0;
+    return total;
+}
+
+const char *summary_type_name(int type) {
+    return type >= 0 && type < SUMMARY_TYPES ? type_names[type] : "unknown";
+}
+
+void summary_cleanup() {
+    free(slots);
+    slots = NULL;
+    slot_cap = slot_used = 0;
+}
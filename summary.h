@@ -0,0 +1,38 @@
+// summary.h
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include <stdint.h>
+
+// Event types counted per directory
+#define SUMMARY_CREATED     0
+#define SUMMARY_DELETED     1
+#define SUMMARY_MODIFIED    2
+#define SUMMARY_MOVED_FROM  3
+#define SUMMARY_MOVED_TO    4
+#define SUMMARY_ATTRIB      5
+#define SUMMARY_TYPES       6
+
+// wd reported for events that did not fit in the table
+#define SUMMARY_OTHER_WD    -1
+
+// Receives one directory's counts when a window is emitted
+typedef void (*summary_emit_cb)(int wd, const uint32_t counts[SUMMARY_TYPES]);
+
+// Allocate a table for up to max_dirs directories per window
+int summary_init(uint32_t max_dirs);
+
+// Count one event (never allocates)
+void summary_record(int wd, uint32_t mask);
+
+// Hand every non-empty directory to cb and start a new window.
+// Returns the total number of events in the window.
+uint64_t summary_emit(summary_emit_cb cb);
+
+// Short name of a counter for output
+const char *summary_type_name(int type);
+
+// Release the table
+void summary_cleanup();
+
+#endif // SUMMARY_H
@@ -0,0 +1,252 @@
+// timer_wheel.c
+#include "timer_wheel.h"
+#include "path_map.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Four levels of 64 slots: 640ms, 41s, 44min and 46h at 10ms ticks.
+// Longer deadlines park in the top level and are re-filed when reached.
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1u << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+#define NO_TIMER        UINT32_MAX
+
+typedef struct {
+    char *path;                 // Key in timer_ids, NULL when free
+    uint64_t expires;           // Absolute tick
+    timer_cb cb;
+    void *arg;
+    uint32_t prev, next;        // Slot list (next also links the free list)
+    uint8_t level, slot;
+} wheel_timer;
+
+static wheel_timer *timers = NULL;
+static uint32_t timer_count = 0;        // Slots used in timers[]
+static uint32_t timer_cap = 0;
+static uint32_t free_timers = NO_TIMER;
+static uint32_t live_timers = 0;
+static uint32_t heads[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t current_tick = 0;       // Last tick processed
+static uint64_t clock_tick = 0;         // Latest time passed to timer_advance
+static uint64_t origin_ms = 0;
+static path_map timer_ids;
+static int wheel_ready = 0;
+
+int timer_wheel_init(uint64_t now_ms) {
+    timer_wheel_cleanup();
+    if (path_map_init(&timer_ids, 1024) < 0) {
+        return -1;
+    }
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (uint32_t s = 0; s < WHEEL_SLOTS; s++) {
+            heads[l][s] = NO_TIMER;
+        }
+    }
+    origin_ms = now_ms;
+    current_tick = clock_tick = 0;
+    wheel_ready = 1;
+    return 0;
+}
+
+static uint64_t to_tick(uint64_t ms) {
+    return ms > origin_ms ? (ms - origin_ms) / TIMER_TICK_MS : 0;
+}
+
+// File a timer in the level whose span covers its remaining time
+static void link_timer(uint32_t idx) {
+    wheel_timer *t = &timers[idx];
+    // A cascaded timer due this very tick lands in the slot about to fire
+    uint64_t delta = t->expires > current_tick ? t->expires - current_tick : 0;
+    uint64_t at = current_tick + delta;
+    int level = 0;
+
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS))) {
+        at = current_tick + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;  // Parked
+    }
+
+    uint32_t slot = (uint32_t)(at >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    t->level = (uint8_t)level;
+    t->slot = (uint8_t)slot;
+    t->prev = NO_TIMER;
+    t->next = heads[level][slot];
+    if (t->next != NO_TIMER) {
+        timers[t->next].prev = idx;
+    }
+    heads[level][slot] = idx;
+}
+
+static void unlink_timer(uint32_t idx) {
+    wheel_timer *t = &timers[idx];
+    if (t->prev != NO_TIMER) {
+        timers[t->prev].next = t->next;
+    } else {
+        heads[t->level][t->slot] = t->next;
+    }
+    if (t->next != NO_TIMER) {
+        timers[t->next].prev = t->prev;
+    }
+}
+
+static void release_timer(uint32_t idx) {
+    free(timers[idx].path);
+    timers[idx].path = NULL;
+    timers[idx].next = free_timers;
+    free_timers = idx;
+    live_timers--;
+}
+
+int timer_schedule(const char *path, uint64_t delay_ms, timer_cb cb, void *arg) {
+    uint32_t idx;
+    if (!wheel_ready) {
+        return -1;
+    }
+
+    uint64_t ticks = (delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (path_map_get(&timer_ids, path, &idx)) {
+        unlink_timer(idx);  // Reschedule in place
+    } else {
+        if (free_timers != NO_TIMER) {
+            idx = free_timers;
+            free_timers = timers[idx].next;
+        } else {
+            if (timer_count == timer_cap) {
+                uint32_t cap = timer_cap ? timer_cap * 2 : 1024;
+                wheel_timer *grown = realloc(timers, cap * sizeof(*timers));
+                if (!grown) {
+                    return -1;
+                }
+                timers = grown;
+                timer_cap = cap;
+            }
+            idx = timer_count++;
+        }
+
+        timers[idx].path = strdup(path);
+        if (!timers[idx].path || path_map_put(&timer_ids, path, idx) < 0) {
+            free(timers[idx].path);
+            timers[idx].path = NULL;
+            timers[idx].next = free_timers;
+            free_timers = idx;
+            return -1;
+        }
+        live_timers++;
+    }
+
+    // Relative to the clock, not the tick being worked through: a callback
+    // rescheduling during catch-up still gets its full delay
+    timers[idx].expires = clock_tick + (ticks ? ticks : 1);
+    timers[idx].cb = cb;
+    timers[idx].arg = arg;
+    link_timer(idx);
+    return 0;
+}
+
+int timer_cancel(const char *path) {
+    uint32_t idx;
+    if (!wheel_ready || !path_map_get(&timer_ids, path, &idx)) {
+        return 0;
+    }
+    unlink_timer(idx);
+    path_map_remove(&timer_ids, path);
+    release_timer(idx);
+    return 1;
+}
+
+// Move a higher-level slot's timers down now that their window has come
+static void cascade(int level, uint32_t slot) {
+    uint32_t idx = heads[level][slot];
+    heads[level][slot] = NO_TIMER;
+    while (idx != NO_TIMER) {
+        uint32_t next = timers[idx].next;
+        link_timer(idx);
+        idx = next;
+    }
+}
+
+uint32_t timer_advance(uint64_t now_ms) {
+    uint64_t target = to_tick(now_ms);
+    uint32_t fired = 0;
+
+    if (!wheel_ready) {
+        return 0;
+    }
+    if (target > clock_tick) {
+        clock_tick = target;
+    }
+
+    while (current_tick < target) {
+        current_tick++;
+
+        // Entering a new window of a level pulls that window's timers down,
+        // highest level first so they can fall through several levels
+        for (int level = WHEEL_LEVELS - 1; level >= 1; level--) {
+            if ((current_tick & ((1ULL << (WHEEL_BITS * level)) - 1)) == 0) {
+                cascade(level, (uint32_t)(current_tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+            }
+        }
+
+        // Take timers off the slot one at a time: a callback may cancel
+        // others due in the same tick, and must find the list intact
+        uint32_t slot = (uint32_t)current_tick & WHEEL_MASK;
+        uint32_t idx;
+        while ((idx = heads[0][slot]) != NO_TIMER) {
+            unlink_timer(idx);
+            if (timers[idx].expires > current_tick) {
+                link_timer(idx);  // A parked long deadline, not due yet
+                continue;
+            }
+
+            // Out of the map first so the callback can schedule the path again
+            path_map_remove(&timer_ids, timers[idx].path);
+            timers[idx].cb(timers[idx].path, timers[idx].arg);
+            release_timer(idx);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+uint64_t timer_next_ms(uint64_t now_ms) {
+    if (!wheel_ready || live_timers == 0) {
+        return UINT64_MAX;
+    }
+
+    // Next non-empty level-0 slot, or the next cascade, whichever is first
+    uint64_t now_tick = to_tick(now_ms);
+    uint64_t ticks = WHEEL_SLOTS - (current_tick & WHEEL_MASK);
+    for (uint32_t d = 1; d < ticks; d++) {
+        if (heads[0][(current_tick + d) & WHEEL_MASK] != NO_TIMER) {
+            ticks = d;
+            break;
+        }
+    }
+
+    uint64_t due = current_tick + ticks;
+    if (due <= now_tick) {
+        return 0;
+    }
+    uint64_t due_ms = origin_ms + due * TIMER_TICK_MS;
+    return due_ms > now_ms ? due_ms - now_ms : 0;
+}
+
+uint32_t timer_pending() {
+    return live_timers;
+}
+
+void timer_wheel_cleanup() {
+    for (uint32_t i = 0; i < timer_count; i++) {
+        free(timers[i].path);
+    }
+    free(timers);
+    if (wheel_ready) {
+        path_map_free(&timer_ids);
+    }
+    timers = NULL;
+    timer_count = timer_cap = live_timers = 0;
+    free_timers = NO_TIMER;
+    wheel_ready = 0;
+}
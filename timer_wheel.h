@@ -0,0 +1,35 @@
+// timer_wheel.h
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#define TIMER_TICK_MS   10      // Resolution of deadlines
+
+// Called when a path's deadline passes. The timer is already gone, so the
+// callback may schedule the same path again.
+typedef void (*timer_cb)(const char *path, void *arg);
+
+// Start the wheel at the given monotonic time
+int timer_wheel_init(uint64_t now_ms);
+
+// Fire cb(path, arg) delay_ms from now, replacing any pending deadline
+// for path. O(1): one hash lookup and two list operations.
+int timer_schedule(const char *path, uint64_t delay_ms, timer_cb cb, void *arg);
+
+// Drop the pending deadline for path; returns 1 if there was one
+int timer_cancel(const char *path);
+
+// Milliseconds until the wheel next needs advancing (UINT64_MAX if idle)
+uint64_t timer_next_ms(uint64_t now_ms);
+
+// Run every deadline up to now_ms; returns the number fired
+uint32_t timer_advance(uint64_t now_ms);
+
+// Number of pending deadlines
+uint32_t timer_pending();
+
+// Drop all deadlines without firing them
+void timer_wheel_cleanup();
+
+#endif // TIMER_WHEEL_H
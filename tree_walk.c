@@ -0,0 +1,77 @@
+// tree_walk.c
+#include "tree_walk.h"
+#include "crawl_throttle.h"
+#include <stdlib.h>
+#include <ftw.h>
+
+// Walk state (nftw has no user pointer)
+static tree_enter_fn walk_enter = NULL;
+static tree_leave_fn walk_leave = NULL;
+static uint32_t *open_dirs = NULL;      // Id of the directory being read at each level
+static int open_depth = 0;
+static int open_cap = 0;
+static uint32_t walk_root = TREE_NONE;
+
+static uint32_t parent_at(int level) {
+    return level > 0 ? open_dirs[level - 1] : TREE_NONE;
+}
+
+// Leave every open directory at level or deeper, innermost first
+static void close_dirs(int level) {
+    while (open_depth > level) {
+        open_depth--;
+        walk_leave(open_dirs[open_depth], parent_at(open_depth));
+    }
+}
+
+static int walk_callback(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    // nftw has no "directory done" step: reaching a shallower entry means
+    // every deeper directory still open has been read to the end
+    close_dirs(ftwbuf->level);
+    if (typeflag == FTW_NS) {
+        return FTW_CONTINUE;  // Gone before it could be stat'ed
+    }
+
+    int is_dir = typeflag == FTW_D || typeflag == FTW_DNR;
+    uint32_t parent = parent_at(ftwbuf->level);
+    uint32_t id = walk_enter(path, sb, parent);
+    if (ftwbuf->level == 0) {
+        walk_root = id;
+    }
+    if (id == TREE_NONE) {
+        return is_dir ? FTW_SKIP_SUBTREE : FTW_CONTINUE;
+    }
+    if (!is_dir) {
+        walk_leave(id, parent);
+        return FTW_CONTINUE;
+    }
+
+    if (open_depth == open_cap) {
+        int cap = open_cap ? open_cap * 2 : 64;
+        uint32_t *grown = realloc(open_dirs, cap * sizeof(*grown));
+        if (!grown) {
+            walk_leave(id, parent);  // Keep the directory, not its contents
+            return FTW_SKIP_SUBTREE;
+        }
+        open_dirs = grown;
+        open_cap = cap;
+    }
+    open_dirs[open_depth++] = id;
+    crawl_throttle();
+    return FTW_CONTINUE;
+}
+
+uint32_t tree_walk(const char *path, tree_enter_fn enter, tree_leave_fn leave) {
+    walk_enter = enter;
+    walk_leave = leave;
+    walk_root = TREE_NONE;
+    open_depth = 0;
+
+    nftw(path, walk_callback, 16, FTW_PHYS | FTW_ACTIONRETVAL);
+    close_dirs(0);
+
+    free(open_dirs);
+    open_dirs = NULL;
+    open_cap = 0;
+    return walk_root;
+}
@@ -0,0 +1,25 @@
+// tree_walk.h
+#ifndef TREE_WALK_H
+#define TREE_WALK_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define TREE_NONE UINT32_MAX
+
+// Called for every entry before anything below it, with the id returned for
+// its directory (TREE_NONE for the walk root). Returns the entry's id, or
+// TREE_NONE to leave it out; an excluded directory's subtree is skipped.
+typedef uint32_t (*tree_enter_fn)(const char *path, const struct stat *st, uint32_t parent);
+
+// Called for every entered entry once everything below it has been left.
+// parent is TREE_NONE for the walk root.
+typedef void (*tree_leave_fn)(uint32_t id, uint32_t parent);
+
+// Walk path and everything below it without following symlinks, throttled
+// per directory (see crawl_throttle.h). Built on nftw like the other
+// crawls; per-level state lives on the heap, not in the caller's stack.
+// Not reentrant. Returns the root's id, or TREE_NONE if it is gone or excluded.
+uint32_t tree_walk(const char *path, tree_enter_fn enter, tree_leave_fn leave);
+
+#endif // TREE_WALK_H
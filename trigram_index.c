@@ -0,0 +1,754 @@
+// trigram_index.c
+#include "trigram_index.h"
+#include "crawl_throttle.h"
+#include "path_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ftw.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC         "FWTI"
+#define INDEX_VERSION       1
+#define MAX_INDEX_FILE_SIZE (16 * 1024 * 1024)  // Larger files are assumed not to be source
+#define MAX_INDEX_THREADS   32
+#define TRIGRAM_SPACE       (1u << 24)
+#define FILE_DEAD           UINT32_MAX
+
+// On-disk structures
+struct trigram_entry {
+    uint32_t trigram;
+    uint32_t count;             // Number of postings
+    uint64_t offset;            // First posting (in entries, not bytes)
+};
+
+struct trigram_file {
+    uint32_t path_off;          // Offset in the path pool
+    uint32_t live;              // 0 once deleted or superseded
+};
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t file_count;
+    uint32_t trigram_count;
+    uint64_t posting_count;
+    uint32_t pool_size;
+    uint32_t reserved;
+} index_header;
+
+// In-memory posting list; ids are appended in increasing order
+typedef struct {
+    uint32_t trigram;
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *ids;
+} posting_list;
+
+// In-memory file slot
+typedef struct {
+    char *path;
+    int live;
+} file_slot;
+
+// Trigram -> posting list table (open addressing, key stored as trigram + 1)
+static uint32_t *tg_keys = NULL;
+static uint32_t *tg_lists = NULL;
+static uint32_t tg_cap = 0;
+static posting_list *lists = NULL;
+static uint32_t list_count = 0;
+static uint32_t list_cap = 0;
+
+// File table; ids are never reused until compaction
+static file_slot *files = NULL;
+static uint32_t file_count = 0;
+static uint32_t file_cap = 0;
+static uint32_t dead_count = 0;
+static path_map path_ids;
+static int index_dirty = 0;
+
+// Crawl state (nftw has no user pointer)
+static int crawl_recursive = 0;
+static trigram_filter crawl_filter = NULL;
+static int crawl_into_index = 0;    // Update the live index instead of collecting paths
+
+// Build state
+typedef struct {
+    uint32_t *trigrams;         // NULL if the file is binary or unreadable
+    uint32_t count;
+} file_trigrams;
+
+static file_trigrams *pending = NULL;
+static uint32_t next_file = 0;
+static uint8_t *update_seen = NULL;  // Bitmap for single-threaded updates
+
+// Extract the set of distinct trigrams of a text file
+static uint32_t *extract_trigrams(const char *path, uint8_t *seen, uint32_t *count) {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > MAX_INDEX_FILE_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t len = (size_t)st.st_size;
+    const uint8_t *data = NULL;
+    if (len > 0) {
+        data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        madvise((void *)data, len, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    // Anything with a NUL byte is treated as binary
+    if (len > 0 && memchr(data, '\0', len)) {
+        munmap((void *)data, len);
+        return NULL;
+    }
+
+    uint32_t n = 0, cap = 256;
+    uint32_t *out = malloc(cap * sizeof(*out));
+    if (!out) {
+        if (len > 0) {
+            munmap((void *)data, len);
+        }
+        return NULL;
+    }
+
+    for (size_t i = 0; i + 2 < len; i++) {
+        uint32_t t = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+        if (seen[t >> 3] & (1u << (t & 7))) {
+            continue;
+        }
+
+        if (n == cap) {
+            uint32_t *grown = realloc(out, cap * 2 * sizeof(*out));
+            if (!grown) {
+                break;
+            }
+            out = grown;
+            cap *= 2;
+        }
+        out[n++] = t;
+        seen[t >> 3] |= (uint8_t)(1u << (t & 7));
+    }
+
+    // Reset only the bits we set so the bitmap can be reused
+    for (uint32_t i = 0; i < n; i++) {
+        seen[out[i] >> 3] = 0;
+    }
+    if (len > 0) {
+        munmap((void *)data, len);
+    }
+
+    *count = n;
+    return out;
+}
+
+// Find or create the posting list for a trigram
+static posting_list *list_for(uint32_t trigram) {
+    if ((list_count + 1) * 2 > tg_cap) {
+        uint32_t cap = tg_cap ? tg_cap * 2 : 4096;
+        uint32_t *keys = calloc(cap, sizeof(*keys));
+        uint32_t *vals = malloc(cap * sizeof(*vals));
+        if (!keys || !vals) {
+            free(keys);
+            free(vals);
+            return NULL;
+        }
+        for (uint32_t i = 0; i < tg_cap; i++) {
+            if (tg_keys[i]) {
+                uint32_t slot = (tg_keys[i] * 2654435761u) & (cap - 1);
+                while (keys[slot]) {
+                    slot = (slot + 1) & (cap - 1);
+                }
+                keys[slot] = tg_keys[i];
+                vals[slot] = tg_lists[i];
+            }
+        }
+        free(tg_keys);
+        free(tg_lists);
+        tg_keys = keys;
+        tg_lists = vals;
+        tg_cap = cap;
+    }
+
+    uint32_t key = trigram + 1;
+    uint32_t slot = (key * 2654435761u) & (tg_cap - 1);
+    while (tg_keys[slot]) {
+        if (tg_keys[slot] == key) {
+            return &lists[tg_lists[slot]];
+        }
+        slot = (slot + 1) & (tg_cap - 1);
+    }
+
+    if (list_count == list_cap) {
+        uint32_t cap = list_cap ? list_cap * 2 : 4096;
+        posting_list *grown = realloc(lists, cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        lists = grown;
+        list_cap = cap;
+    }
+
+    posting_list *pl = &lists[list_count];
+    memset(pl, 0, sizeof(*pl));
+    pl->trigram = trigram;
+    tg_keys[slot] = key;
+    tg_lists[slot] = list_count++;
+    return pl;
+}
+
+// Append file id to the posting list of each trigram
+static int add_postings(uint32_t id, const uint32_t *trigrams, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        posting_list *pl = list_for(trigrams[i]);
+        if (!pl) {
+            return -1;
+        }
+        if (pl->count == pl->cap) {
+            uint32_t cap = pl->cap ? pl->cap * 2 : 4;
+            uint32_t *grown = realloc(pl->ids, cap * sizeof(*grown));
+            if (!grown) {
+                return -1;
+            }
+            pl->ids = grown;
+            pl->cap = cap;
+        }
+        pl->ids[pl->count++] = id;
+    }
+    return 0;
+}
+
+// Append a file slot and return its id
+static int add_file(const char *path, uint32_t *id) {
+    if (file_count == file_cap) {
+        uint32_t cap = file_cap ? file_cap * 2 : 1024;
+        file_slot *grown = realloc(files, cap * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        files = grown;
+        file_cap = cap;
+    }
+
+    char *copy = strdup(path);
+    if (!copy) {
+        return -1;
+    }
+    files[file_count].path = copy;
+    files[file_count].live = 1;
+    *id = file_count++;
+    return 0;
+}
+
+// Mark a file id as no longer present
+static void kill_file(uint32_t id) {
+    if (files[id].live) {
+        files[id].live = 0;
+        dead_count++;
+        index_dirty = 1;
+    }
+}
+
+static int crawl_callback(const char *path, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    if (typeflag == FTW_D && !crawl_recursive && ftwbuf->level > 0) {
+        return FTW_SKIP_SUBTREE;
+    }
+    if (typeflag == FTW_D) {
+        crawl_throttle();
+    }
+    if (typeflag != FTW_F || !S_ISREG(sb->st_mode)) {
+        return FTW_CONTINUE;
+    }
+    if (crawl_filter && !crawl_filter(path + ftwbuf->base)) {
+        return FTW_CONTINUE;
+    }
+
+    if (crawl_into_index) {
+        trigram_index_update(path);
+        return FTW_CONTINUE;
+    }
+
+    uint32_t id;
+    return add_file(path, &id) < 0 ? FTW_STOP : FTW_CONTINUE;
+}
+
+// Worker thread: extract trigrams for files until none are left
+static void *index_worker(void *arg) {
+    (void)arg;
+    uint8_t *seen = calloc(TRIGRAM_SPACE / 8, 1);
+    if (!seen) {
+        return NULL;
+    }
+
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&next_file, 1, __ATOMIC_RELAXED);
+        if (i >= file_count) {
+            break;
+        }
+        pending[i].trigrams = extract_trigrams(files[i].path, seen, &pending[i].count);
+    }
+
+    free(seen);
+    return NULL;
+}
+
+int trigram_index_build(const char *root, int recursive, int threads, trigram_filter filter) {
+    trigram_index_cleanup();
+    if (path_map_init(&path_ids, 1024) < 0) {
+        return -1;
+    }
+
+    crawl_recursive = recursive;
+    crawl_filter = filter;
+    crawl_into_index = 0;
+    if (nftw(root, crawl_callback, 16, FTW_PHYS | FTW_ACTIONRETVAL) != 0) {
+        return -1;
+    }
+
+    pending = calloc(file_count ? file_count : 1, sizeof(*pending));
+    if (!pending) {
+        return -1;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus < 1 ? 1 : (cpus > 8 ? 8 : (int)cpus);
+    }
+    if (threads > MAX_INDEX_THREADS) {
+        threads = MAX_INDEX_THREADS;
+    }
+
+    pthread_t workers[MAX_INDEX_THREADS];
+    int started = 0;
+    next_file = 0;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, index_worker, NULL) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        index_worker(NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    // Merge in file order so posting lists come out sorted; binary files are dropped
+    uint32_t kept = 0;
+    int result = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        if (!pending[i].trigrams) {
+            free(files[i].path);
+            continue;
+        }
+        files[kept] = files[i];
+        if (result == 0 &&
+            (add_postings(kept, pending[i].trigrams, pending[i].count) < 0 ||
+             path_map_put(&path_ids, files[kept].path, kept) < 0)) {
+            result = -1;
+        }
+        free(pending[i].trigrams);
+        kept++;
+    }
+    file_count = kept;
+    free(pending);
+    pending = NULL;
+
+    index_dirty = 1;
+    return result < 0 ? -1 : (int)file_count;
+}
+
+int trigram_index_update(const char *path) {
+    uint32_t id;
+    if (path_map_get(&path_ids, path, &id)) {
+        kill_file(id);
+        path_map_remove(&path_ids, path);
+    }
+
+    if (!update_seen) {
+        update_seen = calloc(TRIGRAM_SPACE / 8, 1);
+        if (!update_seen) {
+            return -1;
+        }
+    }
+
+    uint32_t count;
+    uint32_t *trigrams = extract_trigrams(path, update_seen, &count);
+    if (!trigrams) {
+        return 0;  // Binary, too large, or already gone
+    }
+
+    int result = -1;
+    if (add_file(path, &id) == 0 &&
+        add_postings(id, trigrams, count) == 0 &&
+        path_map_put(&path_ids, path, id) == 0) {
+        result = 0;
+    }
+    free(trigrams);
+    index_dirty = 1;
+    return result;
+}
+
+void trigram_index_remove(const char *path) {
+    uint32_t id;
+    if (path_map_get(&path_ids, path, &id)) {
+        kill_file(id);
+        path_map_remove(&path_ids, path);
+    }
+}
+
+void trigram_index_remove_tree(const char *dir) {
+    size_t len = strlen(dir);
+    for (uint32_t i = 0; i < file_count; i++) {
+        if (files[i].live && strncmp(files[i].path, dir, len) == 0 && files[i].path[len] == '/') {
+            path_map_remove(&path_ids, files[i].path);
+            kill_file(i);
+        }
+    }
+}
+
+void trigram_index_add_tree(const char *dir) {
+    int saved = crawl_recursive;
+    crawl_recursive = 1;
+    crawl_into_index = 1;
+    nftw(dir, crawl_callback, 16, FTW_PHYS | FTW_ACTIONRETVAL);
+    crawl_into_index = 0;
+    crawl_recursive = saved;
+}
+
+int trigram_index_dirty() {
+    return index_dirty;
+}
+
+// Renumber live files densely and drop dead ids from every posting list
+static int compact() {
+    uint32_t *remap = malloc((file_count ? file_count : 1) * sizeof(*remap));
+    if (!remap) {
+        return -1;
+    }
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        if (files[i].live) {
+            remap[i] = kept;
+            files[kept++] = files[i];
+        } else {
+            remap[i] = FILE_DEAD;
+            free(files[i].path);
+        }
+    }
+    file_count = kept;
+    dead_count = 0;
+
+    for (uint32_t l = 0; l < list_count; l++) {
+        posting_list *pl = &lists[l];
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < pl->count; i++) {
+            if (remap[pl->ids[i]] != FILE_DEAD) {
+                pl->ids[n++] = remap[pl->ids[i]];
+            }
+        }
+        pl->count = n;
+    }
+    free(remap);
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        if (path_map_put(&path_ids, files[i].path, i) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int compare_entry(const void *a, const void *b) {
+    const struct trigram_entry *x = a, *y = b;
+    return (x->trigram > y->trigram) - (x->trigram < y->trigram);
+}
+
+int trigram_index_save(const char *file) {
+    if (dead_count * 4 > file_count && compact() < 0) {
+        return -1;
+    }
+
+    // Trigram table sorted for binary search; offsets assigned in table order
+    struct trigram_entry *entries = malloc((list_count ? list_count : 1) * sizeof(*entries));
+    if (!entries) {
+        return -1;
+    }
+    uint32_t entry_count = 0;
+    for (uint32_t l = 0; l < list_count; l++) {
+        if (lists[l].count) {
+            entries[entry_count].trigram = lists[l].trigram;
+            entries[entry_count].count = lists[l].count;
+            entries[entry_count].offset = l;  // Temporarily the list index
+            entry_count++;
+        }
+    }
+    qsort(entries, entry_count, sizeof(*entries), compare_entry);
+
+    uint64_t postings = 0;
+    uint32_t *order = malloc((entry_count ? entry_count : 1) * sizeof(*order));
+    if (!order) {
+        free(entries);
+        return -1;
+    }
+    for (uint32_t e = 0; e < entry_count; e++) {
+        order[e] = (uint32_t)entries[e].offset;
+        entries[e].offset = postings;
+        postings += entries[e].count;
+    }
+
+    uint64_t pool_bytes = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        pool_bytes += strlen(files[i].path) + 1;
+    }
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp || pool_bytes > UINT32_MAX) {
+        if (fp) {
+            fclose(fp);
+        }
+        free(entries);
+        free(order);
+        return -1;
+    }
+
+    index_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, INDEX_MAGIC, 4);
+    hdr.version = INDEX_VERSION;
+    hdr.file_count = file_count;
+    hdr.trigram_count = entry_count;
+    hdr.posting_count = postings;
+    hdr.pool_size = (uint32_t)pool_bytes;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+             fwrite(entries, sizeof(*entries), entry_count, fp) == entry_count;
+    for (uint32_t e = 0; ok && e < entry_count; e++) {
+        const posting_list *pl = &lists[order[e]];
+        ok = fwrite(pl->ids, sizeof(*pl->ids), pl->count, fp) == pl->count;
+    }
+
+    uint32_t off = 0;
+    for (uint32_t i = 0; ok && i < file_count; i++) {
+        struct trigram_file tf = { off, (uint32_t)files[i].live };
+        ok = fwrite(&tf, sizeof(tf), 1, fp) == 1;
+        off += (uint32_t)strlen(files[i].path) + 1;
+    }
+    for (uint32_t i = 0; ok && i < file_count; i++) {
+        size_t len = strlen(files[i].path) + 1;
+        ok = fwrite(files[i].path, 1, len, fp) == len;
+    }
+
+    free(entries);
+    free(order);
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, file) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    index_dirty = 0;
+    return 0;
+}
+
+void trigram_index_cleanup() {
+    for (uint32_t l = 0; l < list_count; l++) {
+        free(lists[l].ids);
+    }
+    for (uint32_t i = 0; i < file_count; i++) {
+        free(files[i].path);
+    }
+    free(lists);
+    free(tg_keys);
+    free(tg_lists);
+    free(files);
+    free(update_seen);
+    path_map_free(&path_ids);
+
+    lists = NULL;
+    tg_keys = tg_lists = NULL;
+    files = NULL;
+    update_seen = NULL;
+    list_count = list_cap = tg_cap = 0;
+    file_count = file_cap = dead_count = 0;
+    index_dirty = 0;
+}
+
+/*
+ * Reader side
+ */
+
+int trigram_view_open(trigram_view *view, const char *file) {
+    memset(view, 0, sizeof(*view));
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(index_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const index_header *hdr = map;
+    uint64_t need = sizeof(*hdr) +
+                    (uint64_t)hdr->trigram_count * sizeof(struct trigram_entry) +
+                    hdr->posting_count * sizeof(uint32_t) +
+                    (uint64_t)hdr->file_count * sizeof(struct trigram_file) +
+                    hdr->pool_size;
+    if (memcmp(hdr->magic, INDEX_MAGIC, 4) != 0 || hdr->version != INDEX_VERSION ||
+        need != (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    const char *p = (const char *)map + sizeof(*hdr);
+    view->map = map;
+    view->map_len = (size_t)st.st_size;
+    view->trigrams = (const struct trigram_entry *)p;
+    p += hdr->trigram_count * sizeof(struct trigram_entry);
+    view->postings = (const uint32_t *)p;
+    p += hdr->posting_count * sizeof(uint32_t);
+    view->files = (const struct trigram_file *)p;
+    p += hdr->file_count * sizeof(struct trigram_file);
+    view->pool = p;
+    view->trigram_count = hdr->trigram_count;
+    view->file_count = hdr->file_count;
+    return 0;
+}
+
+void trigram_view_close(trigram_view *view) {
+    if (view->map) {
+        munmap(view->map, view->map_len);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+static const struct trigram_entry *view_find(const trigram_view *view, uint32_t trigram) {
+    uint32_t lo = 0, hi = view->trigram_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (view->trigrams[mid].trigram < trigram) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < view->trigram_count && view->trigrams[lo].trigram == trigram) {
+        return &view->trigrams[lo];
+    }
+    return NULL;
+}
+
+static int compare_count(const void *a, const void *b) {
+    const struct trigram_entry *x = *(const struct trigram_entry * const *)a;
+    const struct trigram_entry *y = *(const struct trigram_entry * const *)b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+uint32_t trigram_view_candidates(const trigram_view *view, const char *query,
+                                 trigram_candidate_cb cb, void *arg) {
+    size_t len = strlen(query);
+    uint32_t visited = 0;
+
+    // Queries shorter than a trigram can't be narrowed
+    if (len < 3) {
+        for (uint32_t i = 0; i < view->file_count; i++) {
+            if (view->files[i].live) {
+                visited++;
+                if (cb(view->pool + view->files[i].path_off, arg)) {
+                    break;
+                }
+            }
+        }
+        return visited;
+    }
+
+    size_t n = len - 2;
+    const struct trigram_entry **lists_for = malloc(n * sizeof(*lists_for));
+    uint64_t *cursor = calloc(n, sizeof(*cursor));
+    if (!lists_for || !cursor) {
+        free(lists_for);
+        free(cursor);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *q = (const uint8_t *)query + i;
+        lists_for[i] = view_find(view, ((uint32_t)q[0] << 16) | ((uint32_t)q[1] << 8) | q[2]);
+        if (!lists_for[i]) {
+            free(lists_for);
+            free(cursor);
+            return 0;  // Some trigram occurs nowhere
+        }
+    }
+
+    // Drive the intersection from the rarest trigram
+    qsort(lists_for, n, sizeof(*lists_for), compare_count);
+
+    const struct trigram_entry *driver = lists_for[0];
+    for (uint32_t k = 0; k < driver->count; k++) {
+        uint32_t id = view->postings[driver->offset + k];
+        int all = 1;
+
+        for (size_t i = 1; i < n && all; i++) {
+            const struct trigram_entry *e = lists_for[i];
+            const uint32_t *ids = view->postings + e->offset;
+            while (cursor[i] < e->count && ids[cursor[i]] < id) {
+                cursor[i]++;
+            }
+            all = cursor[i] < e->count && ids[cursor[i]] == id;
+        }
+
+        if (all && id < view->file_count && view->files[id].live) {
+            visited++;
+            if (cb(view->pool + view->files[id].path_off, arg)) {
+                break;
+            }
+        }
+    }
+
+    free(lists_for);
+    free(cursor);
+    return visited;
+}
+
+uint32_t trigram_view_live_files(const trigram_view *view) {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < view->file_count; i++) {
+        live += view->files[i].live != 0;
+    }
+    return live;
+}
@@ -0,0 +1,69 @@
+// trigram_index.h
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Filename filter applied while crawling (1 = include)
+typedef int (*trigram_filter)(const char *filename);
+
+// Read-only view of a saved index (mmap'd)
+typedef struct {
+    void *map;
+    size_t map_len;
+    const struct trigram_entry *trigrams;
+    const uint32_t *postings;
+    const struct trigram_file *files;
+    const char *pool;
+    uint32_t trigram_count;
+    uint32_t file_count;
+} trigram_view;
+
+// Called once per candidate file; return non-zero to stop
+typedef int (*trigram_candidate_cb)(const char *path, void *arg);
+
+/*
+ * Writer side (fswatcher)
+ */
+
+// Index every text file under root using a pool of worker threads.
+// Returns the number of files indexed, or -1 on error.
+int trigram_index_build(const char *root, int recursive, int threads, trigram_filter filter);
+
+// (Re)index one file after it was created or modified
+int trigram_index_update(const char *path);
+
+// Drop one file, or every file below a directory
+void trigram_index_remove(const char *path);
+void trigram_index_remove_tree(const char *dir);
+
+// Index every file below a directory moved into the tree
+void trigram_index_add_tree(const char *dir);
+
+// Has the index changed since the last save?
+int trigram_index_dirty();
+
+// Write the index atomically to file (compacting dead entries if needed)
+int trigram_index_save(const char *file);
+
+// Release the in-memory index
+void trigram_index_cleanup();
+
+/*
+ * Reader side (fsgrep)
+ */
+
+// Map a saved index read-only
+int trigram_view_open(trigram_view *view, const char *file);
+void trigram_view_close(trigram_view *view);
+
+// Enumerate live files that contain every trigram of query.
+// Returns the number of candidates visited.
+uint32_t trigram_view_candidates(const trigram_view *view, const char *query,
+                                 trigram_candidate_cb cb, void *arg);
+
+// Number of live files in the view
+uint32_t trigram_view_live_files(const trigram_view *view);
+
+#endif // TRIGRAM_INDEX_H
@@ -0,0 +1,307 @@
+// usage.c
+#include "usage.h"
+#include "path_map.h"
+#include "tree_walk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define NO_NODE UINT32_MAX
+
+// One tracked path. Directories keep their subtree totals, so a query
+// is a lookup; a change walks up the parent chain adding the difference.
+typedef struct {
+    char *path;                 // Full path (key in node_ids), NULL when free
+    usage_totals own;           // This entry alone
+    usage_totals total;         // This entry plus everything below it
+    uint64_t ino;               // A directory renamed over this one has another inode
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;      // Also links the free list
+    uint32_t prev_sibling;
+    int is_dir;
+} usage_node;
+
+static usage_node *nodes = NULL;
+static uint32_t node_count = 0;
+static uint32_t node_cap = 0;
+static uint32_t free_nodes = NO_NODE;
+static uint32_t root_count = 0;        // Trees measured (startup root and added ones)
+static path_map node_ids;
+
+// Collapse repeated slashes and drop a trailing one (see merkle.c)
+static void normalize_path(char *dst, const char *src, size_t size) {
+    size_t n = 0;
+    for (; *src && n + 1 < size; src++) {
+        if (*src == '/' && n > 0 && dst[n - 1] == '/') {
+            continue;
+        }
+        dst[n++] = *src;
+    }
+    while (n > 1 && dst[n - 1] == '/') {
+        n--;
+    }
+    dst[n] = '\0';
+}
+
+// Is path root itself or below it?
+static int is_under(const char *path, const char *root) {
+    size_t len = strlen(root);
+    return strncmp(path, root, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+static void measure(const struct stat *st, usage_totals *t) {
+    t->bytes = (uint64_t)st->st_blocks * 512;
+    t->apparent = (uint64_t)st->st_size;
+    t->files = !S_ISDIR(st->st_mode);
+    t->dirs = S_ISDIR(st->st_mode);
+}
+
+// dst += src - sub, component-wise (unsigned arithmetic wraps correctly)
+static void apply(usage_totals *dst, const usage_totals *src, const usage_totals *sub) {
+    dst->bytes += src->bytes - sub->bytes;
+    dst->apparent += src->apparent - sub->apparent;
+    dst->files += src->files - sub->files;
+    dst->dirs += src->dirs - sub->dirs;
+}
+
+static void add_to_ancestors(uint32_t idx, const usage_totals *add, const usage_totals *sub) {
+    for (uint32_t p = nodes[idx].parent; p != NO_NODE; p = nodes[p].parent) {
+        apply(&nodes[p].total, add, sub);
+    }
+}
+
+static uint32_t node_alloc(const char *path) {
+    uint32_t idx;
+
+    if (free_nodes != NO_NODE) {
+        idx = free_nodes;
+        free_nodes = nodes[idx].next_sibling;
+    } else {
+        if (node_count == node_cap) {
+            uint32_t cap = node_cap ? node_cap * 2 : 1024;
+            usage_node *grown = realloc(nodes, cap * sizeof(*nodes));
+            if (!grown) {
+                return NO_NODE;
+            }
+            nodes = grown;
+            node_cap = cap;
+        }
+        idx = node_count++;
+    }
+
+    memset(&nodes[idx], 0, sizeof(nodes[idx]));
+    nodes[idx].path = strdup(path);
+    if (!nodes[idx].path || path_map_put(&node_ids, path, idx) < 0) {
+        free(nodes[idx].path);
+        nodes[idx].path = NULL;
+        nodes[idx].next_sibling = free_nodes;
+        free_nodes = idx;
+        return NO_NODE;
+    }
+    nodes[idx].parent = nodes[idx].first_child = NO_NODE;
+    nodes[idx].next_sibling = nodes[idx].prev_sibling = NO_NODE;
+    return idx;
+}
+
+static void link_child(uint32_t parent, uint32_t idx) {
+    usage_node *p = &nodes[parent];
+    usage_node *n = &nodes[idx];
+
+    n->parent = parent;
+    n->next_sibling = p->first_child;
+    if (p->first_child != NO_NODE) {
+        nodes[p->first_child].prev_sibling = idx;
+    }
+    p->first_child = idx;
+}
+
+static void unlink_child(uint32_t idx) {
+    usage_node *n = &nodes[idx];
+
+    if (n->prev_sibling != NO_NODE) {
+        nodes[n->prev_sibling].next_sibling = n->next_sibling;
+    } else {
+        nodes[n->parent].first_child = n->next_sibling;
+    }
+    if (n->next_sibling != NO_NODE) {
+        nodes[n->next_sibling].prev_sibling = n->prev_sibling;
+    }
+}
+
+// Free a node and everything below it (links to it are the caller's job)
+static void free_subtree(uint32_t idx) {
+    uint32_t child = nodes[idx].first_child;
+    while (child != NO_NODE) {
+        uint32_t next = nodes[child].next_sibling;
+        free_subtree(child);
+        child = next;
+    }
+
+    path_map_remove(&node_ids, nodes[idx].path);
+    free(nodes[idx].path);
+    nodes[idx].path = NULL;
+    nodes[idx].next_sibling = free_nodes;
+    free_nodes = idx;
+}
+
+// Walk callbacks for scan(): each node's totals are complete when it is
+// left, and are added to its parent as it is linked in
+static uint32_t enter_node(const char *path, const struct stat *st, uint32_t parent) {
+    (void)parent;
+    uint32_t idx = node_alloc(path);
+    if (idx == NO_NODE) {
+        return NO_NODE;
+    }
+    nodes[idx].is_dir = S_ISDIR(st->st_mode);
+    nodes[idx].ino = (uint64_t)st->st_ino;
+    measure(st, &nodes[idx].own);
+    nodes[idx].total = nodes[idx].own;
+    return idx;
+}
+
+static void leave_node(uint32_t idx, uint32_t parent) {
+    static const usage_totals zero;
+    if (parent != NO_NODE) {
+        link_child(parent, idx);
+        apply(&nodes[parent].total, &nodes[idx].total, &zero);
+    }
+}
+
+// Measure path (and everything below a directory) and attach it below parent.
+// Totals of the new subtree are summed here; ancestors are the caller's job.
+static uint32_t scan(const char *path, uint32_t parent) {
+    uint32_t idx = tree_walk(path, enter_node, leave_node);
+    if (idx != NO_NODE && parent != NO_NODE) {
+        link_child(parent, idx);
+    }
+    return idx;
+}
+
+int usage_build(const char *root) {
+    usage_cleanup();
+    if (usage_add_root(root) < 0) {
+        return -1;
+    }
+    return (int)node_ids.count;
+}
+
+// Free every tracked root at or below path
+static int drop_roots(const char *path) {
+    int dropped = 0;
+    for (uint32_t i = 0; i < node_count; i++) {
+        if (nodes[i].path && nodes[i].parent == NO_NODE && is_under(nodes[i].path, path)) {
+            free_subtree(i);
+            root_count--;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+int usage_add_root(const char *root) {
+    char path[PATH_MAX];
+    uint32_t idx;
+
+    if (!node_ids.cap && path_map_init(&node_ids, 1024) < 0) {
+        return -1;
+    }
+    normalize_path(path, root, sizeof(path));
+    if (path_map_get(&node_ids, path, &idx)) {
+        return 0;  // Already measured as part of another root
+    }
+
+    // Roots below this one are measured again as part of it
+    drop_roots(path);
+    if (scan(path, NO_NODE) == NO_NODE) {
+        return -1;
+    }
+    root_count++;
+    return (int)node_ids.count;
+}
+
+int usage_remove_root(const char *root) {
+    char path[PATH_MAX];
+
+    normalize_path(path, root, sizeof(path));
+    return drop_roots(path);
+}
+
+void usage_update(const char *path) {
+    static const usage_totals zero;
+    char norm[PATH_MAX];
+    char dir[PATH_MAX];
+    uint32_t idx, parent;
+
+    if (!root_count) {
+        return;
+    }
+
+    normalize_path(norm, path, sizeof(norm));
+    const char *slash = strrchr(norm, '/');
+    if (!slash || slash == norm) {
+        return;
+    }
+    memcpy(dir, norm, (size_t)(slash - norm));
+    dir[slash - norm] = '\0';
+    if (!path_map_get(&node_ids, dir, &parent) || !nodes[parent].is_dir) {
+        return;  // Outside the tree
+    }
+
+    struct stat st;
+    int exists = lstat(norm, &st) == 0;
+    int known = path_map_get(&node_ids, norm, &idx);
+
+    // Same entry as before: only its own size can have changed
+    if (known && exists && nodes[idx].is_dir == !!S_ISDIR(st.st_mode) &&
+        (!nodes[idx].is_dir || nodes[idx].ino == (uint64_t)st.st_ino)) {
+        usage_totals now;
+        measure(&st, &now);
+        apply(&nodes[idx].total, &now, &nodes[idx].own);
+        add_to_ancestors(idx, &now, &nodes[idx].own);
+        nodes[idx].own = now;
+        return;
+    }
+
+    if (known) {
+        add_to_ancestors(idx, &zero, &nodes[idx].total);
+        unlink_child(idx);
+        free_subtree(idx);
+    }
+    if (exists) {
+        idx = scan(norm, parent);
+        if (idx != NO_NODE) {
+            add_to_ancestors(idx, &nodes[idx].total, &zero);
+        }
+    }
+}
+
+int usage_query(const char *path, usage_totals *out) {
+    char norm[PATH_MAX];
+    uint32_t idx;
+
+    if (!root_count) {
+        return -1;
+    }
+    normalize_path(norm, path, sizeof(norm));
+    if (!path_map_get(&node_ids, norm, &idx)) {
+        return -1;
+    }
+    *out = nodes[idx].total;
+    return 0;
+}
+
+void usage_cleanup() {
+    for (uint32_t i = 0; i < node_count; i++) {
+        free(nodes[i].path);
+    }
+    free(nodes);
+    path_map_free(&node_ids);
+
+    nodes = NULL;
+    node_count = node_cap = 0;
+    free_nodes = NO_NODE;
+    root_count = 0;
+}
@@ -0,0 +1,37 @@
+// usage.h
+#ifndef USAGE_H
+#define USAGE_H
+
+#include <stdint.h>
+
+// Space used by a subtree
+typedef struct {
+    uint64_t bytes;             // Allocated on disk (st_blocks), as du reports
+    uint64_t apparent;          // Sum of st_size
+    uint64_t files;             // Everything that is not a directory
+    uint64_t dirs;              // Directories, including the subtree root
+} usage_totals;
+
+// Measure everything under root once. Returns the number of entries
+// tracked, or -1 on error.
+int usage_build(const char *root);
+
+// Measure another root (one added at runtime). A path already inside a
+// tracked root is left as it is; roots below it are folded into it.
+// Returns the number of entries tracked, or -1 on error.
+int usage_add_root(const char *root);
+
+// Forget every tracked root at or below root. Returns how many were dropped.
+int usage_remove_root(const char *root);
+
+// Re-read one path after an event and apply the difference to every
+// directory above it. Hard links are counted once per link.
+void usage_update(const char *path);
+
+// Current totals for a tracked path (0), or -1 if it is not tracked
+int usage_query(const char *path, usage_totals *out);
+
+// Release the tree
+void usage_cleanup();
+
+#endif // USAGE_H